@@ -0,0 +1,67 @@
+/* Times the dict table behind environments on its own, away from the
+ * interpreter: inserts, lookups and a rolling window of removals, the
+ * pattern that made each removal a pass over the table before it was a
+ * Swiss table. Built and run by bench/dict-table.sh */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../include/atom.h"
+#include "../include/dict.h"
+
+#define KEYS 100000
+#define LOOKUPS 50
+#define WINDOW 300
+#define CHURN 20000
+
+static void* copy_val(const void* v) {
+    return (void*)v;
+}
+
+static void del_val(void* v) {
+}
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(void) {
+    static zlatom* keys[KEYS + WINDOW];
+    char name[32];
+    for (int i = 0; i < KEYS + WINDOW; i++) {
+        snprintf(name, sizeof(name), "k%d", i);
+        keys[i] = zlatom_intern(name);
+    }
+
+    double start = seconds();
+    dict* d = dict_new(copy_val, del_val);
+    for (int i = 0; i < KEYS; i++) {
+        dict_put(d, keys[i], (void*)(intptr_t)(i + 1));
+    }
+    long sum = 0;
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < KEYS; i++) {
+            sum += (intptr_t)dict_get(d, keys[i]);
+        }
+    }
+    dict_del(d);
+    double filled = seconds();
+
+    d = dict_new(copy_val, del_val);
+    for (int i = 0; i < CHURN; i++) {
+        dict_put(d, keys[i + WINDOW], (void*)(intptr_t)(i + 1));
+        if (dict_get(d, keys[i + WINDOW / 2])) {
+            sum++;
+        }
+        dict_rm(d, keys[i]);
+    }
+    dict_del(d);
+    double churned = seconds();
+
+    printf("insert+lookup %.3fs   churn %.3fs   (%ld)\n", filled - start, churned - filled, sum);
+    return 0;
+}
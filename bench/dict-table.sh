@@ -0,0 +1,23 @@
+#!/bin/bash
+# Builds bench/dict-table.c against the dict table as it was before it
+# became a Swiss table and against the one in the tree, both unoptimized
+# as the Makefile builds and with -O2, and times them. Run from the
+# repository root.
+set -e
+
+before=54718b6^
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+mkdir -p "$dir/before/bench"
+git archive "$before" src include | tar -x -C "$dir/before"
+cp bench/dict-table.c "$dir/before/bench/"
+
+for flags in -g -O2; do
+    for tree in "$dir/before" "$PWD"; do
+        (cd "$tree" && cc -std=c11 $flags -o "$dir/harness" \
+            bench/dict-table.c src/dict.c src/atom.c src/pool.c src/util.c -lm 2> /dev/null)
+        name=$([ "$tree" = "$PWD" ] && echo after || echo before)
+        printf "%-4s %-7s %s\n" "$flags" "$name" "$("$dir/harness")"
+    done
+done
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Parse throughput: generates a source file of about the given number of
+# megabytes (8 by default) made of quoted forms mixing every kind of token,
+# and times reading it. The forms evaluate to themselves, so the time is
+# almost all spent in the reader, which is built without images so every
+# run reads the source. Run from the repository root.
+set -e
+
+mb=${1:-8}
+input=out/bench/parse-input.spow
+
+make -s IMAGES=0 BINDIR=out/bench/reader OBJDIR=out/bench/reader-obj > /dev/null
+
+awk -v mb="$mb" 'BEGIN {
+    form = "{(func (step-%d x) (if (<= x 0) -1.5 (+ x %d)))" \
+        " \"a string with \\\"escapes\\\" and\\ta tab\" :qsym :\"quoted qsym\"" \
+        " [:key %d \"name\" '\''single'\'' 12345678901234567890123 {nested {list}}]" \
+        " \\(+ %d 1) @{spliced list} true false  # and a comment\n}\n"
+    size = 0
+    for (i = 0; size < mb * 1048576; i++) {
+        line = sprintf(form, i, i, i, i)
+        printf "%s", line
+        size += length(line)
+    }
+}' > "$input"
+
+TIMEFORMAT="%R"
+t=$( { time ./out/bench/reader/spow "$input" > /dev/null; } 2>&1 )
+printf "%-20s %6sMB   %6ss\n" "$(basename "$input")" "$(( $(wc -c < "$input") / 1048576 ))" "$t"
@@ -0,0 +1,17 @@
+#!/bin/bash
+# Times every benchmark against the bytecode VM, the tree walking
+# evaluator and a VM build allocating with plain malloc. Run from the
+# repository root.
+set -e
+
+make -s VM=1 > /dev/null
+make -s VM=0 BINDIR=out/bench/walker OBJDIR=out/bench/obj > /dev/null
+make -s POOL=0 BINDIR=out/bench/malloc OBJDIR=out/bench/malloc-obj > /dev/null
+
+TIMEFORMAT="%R"
+for b in bench/*.spow; do
+    vm=$( { time ./out/bin/spow "$b" > /dev/null; } 2>&1 )
+    walker=$( { time ./out/bench/walker/spow "$b" > /dev/null; } 2>&1 )
+    malloc=$( { time ./out/bench/malloc/spow "$b" > /dev/null; } 2>&1 )
+    printf "%-20s vm %6ss   tree walker %6ss   malloc %6ss\n" "$(basename "$b")" "$vm" "$walker" "$malloc"
+done
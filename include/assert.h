@@ -33,6 +33,11 @@
             "function '%s' passed incorrect type for arg %i; got %s, expected expression type", \
             fname, i, zlval_type_name(args->cell[i]->type));
 
+#define ZLASSERT_ISHASHABLE(args, i, fname) \
+    ZLASSERT(args, (zlval_hashable(args->cell[i])), \
+            "function '%s' passed incorrect type for arg %i; got %s, expected hashable type", \
+            fname, i, zlval_type_name(args->cell[i]->type));
+
 #define ZLASSERT_ARGCOUNT(args, expected, fname) \
     ZLASSERT(args, (args->count == expected), \
             "function '%s' takes exactly %i argument(s); %i given", fname, expected, args->count);
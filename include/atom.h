@@ -0,0 +1,17 @@
+#ifndef ZL_ATOM_H
+#define ZL_ATOM_H
+
+/* An interned symbol name. Every distinct name exists exactly once, so
+ * atoms can be compared by pointer */
+typedef struct zlatom {
+    unsigned int hash;
+    int length;
+    char name[];
+} zlatom;
+
+zlatom* zlatom_intern(const char* name);
+/* the atom of the length chars at name, which need not end there */
+zlatom* zlatom_intern_len(const char* name, int length);
+void zlatom_teardown(void);
+
+#endif
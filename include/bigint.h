@@ -0,0 +1,38 @@
+#ifndef ZL_BIGINT_H
+#define ZL_BIGINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Arbitrary precision integer: the magnitude is stored little endian in
+ * base 2^32 limbs without leading zero limbs, so zero has no limbs.
+ * Results are always freshly allocated, and released with free */
+typedef struct zlbigint {
+    int count;
+    bool negative;
+    uint32_t limbs[];
+} zlbigint;
+
+/* Products longer than this many limbs (512KB, about 1.26 million decimal
+ * digits) are not made: zlbigint_mul
+ * and zlbigint_pow return NULL rather than a result that large */
+#define ZLBIGINT_MAX_LIMBS (1 << 17)
+
+zlbigint* zlbigint_from_long(long x);
+zlbigint* zlbigint_from_double(double x);
+zlbigint* zlbigint_parse(const char* s);
+zlbigint* zlbigint_copy(const zlbigint* a);
+
+bool zlbigint_to_long(const zlbigint* a, long* x);
+double zlbigint_to_double(const zlbigint* a);
+char* zlbigint_to_str(const zlbigint* a);
+
+int zlbigint_cmp(const zlbigint* a, const zlbigint* b);
+zlbigint* zlbigint_neg(const zlbigint* a);
+zlbigint* zlbigint_add(const zlbigint* a, const zlbigint* b);
+zlbigint* zlbigint_sub(const zlbigint* a, const zlbigint* b);
+zlbigint* zlbigint_mul(const zlbigint* a, const zlbigint* b);
+zlbigint* zlbigint_divmod(const zlbigint* a, const zlbigint* b, zlbigint** rem);
+zlbigint* zlbigint_pow(const zlbigint* a, unsigned long n);
+
+#endif
@@ -4,8 +4,11 @@
 #include <stdbool.h>
 #include "types.h"
 
+/* arithmetic operator, see builtin_num_op */
+typedef struct zlnum_op zlnum_op;
+
 /* language builtins */
-zlval* builtin_num_op(zlenv* e, zlval* a, char* op);
+zlval* builtin_num_op(zlenv* e, zlval* a, const zlnum_op* op);
 zlval* builtin_add(zlenv* e, zlval* a);
 zlval* builtin_sub(zlenv* e, zlval* a);
 zlval* builtin_mul(zlenv* e, zlval* a);
@@ -62,9 +65,16 @@ zlval* builtin_macro(zlenv* e, zlval* a);
 zlval* builtin_typeof(zlenv* e, zlval* a);
 zlval* builtin_convert(zlenv* e, zlval* a);
 zlval* builtin_import(zlenv* e, zlval* a);
+/* import for the scripts run from the command line, which unlike the
+ * files they import aren't cached as images */
+zlval* builtin_run_script(zlenv* e, zlval* a);
 zlval* builtin_print(zlenv* e, zlval* a);
 zlval* builtin_println(zlenv* e, zlval* a);
 zlval* builtin_random(zlenv* e, zlval* a);
+zlval* builtin_allocstats(zlenv* e, zlval* a);
+zlval* builtin_gc(zlenv* e, zlval* a);
+zlval* builtin_gcthreshold(zlenv* e, zlval* a);
+zlval* builtin_macroexpansions(zlenv* e, zlval* a);
 zlval* builtin_error(zlenv* e, zlval* a);
 zlval* builtin_exit(zlenv* e, zlval* a);
 
@@ -0,0 +1,58 @@
+#ifndef ZL_COMPILE_H
+#define ZL_COMPILE_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* bytecode instructions; operands are 16 bit and follow the opcode */
+typedef enum {
+    ZLOP_CONST,         /* k: push a copy of constant k */
+    ZLOP_LOAD,          /* k: push the value bound to symbol constant k */
+    ZLOP_LOAD_SLOT,     /* k depth slot: push the local symbol constant k resolved to */
+    ZLOP_EVAL,          /* k: push the tree walked evaluation of form k */
+    ZLOP_PREPARE,       /* slow argc: keep going if the callee takes argc evaluated args, else jump */
+    ZLOP_ARG,           /* end n: if the callee n values down is a function and the arg
+                         * on top is an error, drop them all and jump to end with it */
+    ZLOP_INVOKE,        /* argc: call callee with evaluated args */
+    ZLOP_TAIL_INVOKE,   /* argc: like INVOKE, reusing the current frame */
+    ZLOP_CALL,          /* k: call callee with the unevaluated args of form k */
+    ZLOP_TAIL_CALL,     /* k: like CALL, handing the result back to the caller */
+    ZLOP_IF,            /* slow: keep going if callee is the 'if' builtin, else jump */
+    ZLOP_BRANCH,        /* else end: pop a boolean, jump to else if false */
+    ZLOP_JUMP,          /* target */
+    ZLOP_RETURN
+} zlopcode_t;
+
+typedef enum {
+    ZLCHUNK_PENDING,
+    ZLCHUNK_COMPILED,
+    ZLCHUNK_FAILED
+} zlchunk_state_t;
+
+/* compiled function body, shared by every copy of the function */
+struct zlchunk {
+    zlchunk_state_t state;
+    int references;
+
+    unsigned char* code;
+    int code_count;
+    int code_size;
+
+    zlval** consts;
+    int const_count;
+    int const_size;
+
+    int max_stack;
+};
+
+zlchunk* zlchunk_new(void);
+zlchunk* zlchunk_retain(zlchunk* c);
+void zlchunk_release(zlchunk* c);
+bool zlchunk_compile(zlchunk* c, const zlval* body, const zlenv* frame);
+
+static inline int zlchunk_read_short(const zlchunk* c, int ip) {
+    return c->code[ip] | (c->code[ip + 1] << 8);
+}
+
+#endif
@@ -3,14 +3,33 @@
 
 #include <stdbool.h>
 
+#include "atom.h"
+
 typedef void*(*copy_fn)(const void*);
 typedef void(*del_fn)(void*);
 
+/* entries kept inline before the dict moves to a hash table */
+#define DICT_SMALL_SIZE 8
+
 typedef struct dict {
-    int size;
+    /* live entries, entries appended so far and room for entries */
     int count;
-    char** syms;
+    int used;
+    int capacity;
+    /* slots in the index, 0 while the dict is small */
+    int size;
+
+    /* Entries in insertion order, with NULL keys where one was removed.
+     * See dict.c for the index; a small dict has none and keeps its
+     * entries in the inline arrays */
+    zlatom** syms;
     void** vals;
+    unsigned char* ctrl;
+    void* index;
+
+    zlatom* small_syms[DICT_SMALL_SIZE];
+    void* small_vals[DICT_SMALL_SIZE];
+
     copy_fn copier;
     del_fn deleter;
 } dict;
@@ -18,15 +37,14 @@ typedef struct dict {
 dict* dict_new(const copy_fn copier, const del_fn deleter);
 dict* dict_new_no_bindings(void);
 void dict_del(dict* d);
-int dict_index(const dict* d, const char* k);
-void* dict_get(const dict* d, const char* k);
+int dict_index(const dict* d, const zlatom* k);
+void* dict_get(const dict* d, const zlatom* k);
 void* dict_get_at(const dict* d, int i);
-void dict_put(dict* d, const char* k, void* v);
-void dict_rm(dict* d, const char* k);
+void dict_put(dict* d, zlatom* k, void* v);
+void dict_rm(dict* d, const zlatom* k);
 dict* dict_copy(const dict* d);
 int dict_count(const dict* d);
-char** dict_all_keys(const dict* d);
+zlatom** dict_all_keys(const dict* d);
 void** dict_all_vals(const dict* d);
-bool dict_equal(const dict* d1, const dict* d2);
 
 #endif
@@ -18,13 +18,21 @@
 #include "types.h"
 
 void zlval_eval_abort(void);
+bool zlval_eval_check_abort(void);
 
 /* eval functions */
 zlval* zlval_eval(zlenv* e, zlval* v);
+zlval* zlval_eval_result(zlenv* e, zlval* x);
 zlval* zlval_eval_arg(zlenv* e, zlval* v, int arg);
 zlval* zlval_eval_args(zlenv* e, zlval* v);
 zlval* zlval_eval_sexpr(zlenv* e, zlval* v);
 zlval* zlval_call(zlenv* e, zlval* f, zlval* a);
+/* zlval_call for a call made by the form site, which keeps the expansion
+ * of a macro called from it */
+zlval* zlval_call_site(zlenv* e, zlval* f, zlval* a, zlval* site);
+/* the expansion site keeps for a call to f, or NULL */
+zlval* zlval_kept_expansion(const zlval* site, const zlval* f);
+zlenv* zlval_enter(zlval* f);
 zlval* zlval_eval_macro(zlval* m);
 zlval* zlval_eval_inside_qexpr(zlenv* e, zlval* v);
 zlval* zlval_eval_cexpr(zlenv* e, zlval* v);
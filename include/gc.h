@@ -0,0 +1,30 @@
+#ifndef ZL_GC_H
+#define ZL_GC_H
+
+#include "types.h"
+
+/* How many environments may be live before the cycle collector first runs.
+ * Build with -DSPOW_GC_THRESHOLD=0 to only collect on (gc) */
+#ifndef SPOW_GC_THRESHOLD
+#define SPOW_GC_THRESHOLD 4096
+#endif
+
+typedef struct {
+    long collections;
+    /* environments reclaimed in total and by the last collection */
+    long reclaimed;
+    long last_reclaimed;
+    /* environments, values and cell buffers traced by the last collection */
+    long last_traced;
+    long live;
+    long threshold;
+} zlgc_stats;
+
+void zlgc_track(zlenv* e);
+void zlgc_untrack(zlenv* e);
+int zlgc_collect(void);
+void zlgc_poll(void);
+void zlgc_set_threshold(long threshold);
+void zlgc_get_stats(zlgc_stats* s);
+
+#endif
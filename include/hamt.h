@@ -0,0 +1,72 @@
+#ifndef ZL_HAMT_H
+#define ZL_HAMT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/* a binding in a dict value, with the hash of its key; seq numbers the
+ * entries by first insertion */
+typedef struct zlhamt_entry {
+    zlval* key;
+    unsigned int hash;
+    zlval* val;
+    unsigned long seq;
+} zlhamt_entry;
+
+/* Persistent hash array mapped trie backing dict values, keyed by any value
+ * zlval_hashable accepts. Each node maps the next 5 bits of a key's hash
+ * to either an entry or a child node, with a bitmap for each: the entries
+ * are stored first, then the children, both in bit order. Nodes past the
+ * last bits of the hash hold colliding keys in a plain list instead.
+ *
+ * Nodes are refcounted and only changed in place while unshared, so every
+ * version of a dict shares all the nodes off the paths that were changed.
+ * The empty trie is NULL */
+struct zlhamt {
+    int references;
+    uint32_t datamap;
+    uint32_t nodemap;
+    /* entries of a collision node, 0 for the others */
+    int collisions;
+
+    int gc_refs;
+    unsigned char gc_state;
+
+    zlhamt_entry entries[];
+};
+
+/* functions below take over the reference to the trie they are given and
+ * return one to the result */
+/* seq is the one to give k if it is new, and is set to k's */
+zlhamt* zlhamt_set(zlhamt* t, zlval* k, zlval* v, unsigned long* seq, bool* added);
+/* seq is set to that of k, if it was there */
+zlhamt* zlhamt_rm(zlhamt* t, const zlval* k, unsigned long* seq, bool* removed);
+
+zlhamt* zlhamt_retain(zlhamt* t);
+void zlhamt_release(zlhamt* t);
+/* NULL if k isn't there; the value is not copied */
+zlval* zlhamt_get(const zlhamt* t, const zlval* k);
+/* whether two tries holding the same number of entries bind equal keys to
+ * equal values */
+bool zlhamt_equal(const zlhamt* a, const zlhamt* b);
+
+int zlhamt_node_entries(const zlhamt* n);
+int zlhamt_node_children(const zlhamt* n);
+zlhamt** zlhamt_node_child(const zlhamt* n);
+/* A dict also keeps its entries in an order trie, made of the same nodes
+ * but keyed by seq: each level takes the next 5 bits of it from the top,
+ * and the entries are all on the bottom level, with their hash left 0.
+ * Walking it visits the entries in insertion order without searching or
+ * sorting. shift is that of the top level, which zlhamt_order_set raises
+ * as the seqs outgrow it; an empty order trie is NULL */
+zlhamt* zlhamt_order_set(zlhamt* t, int* shift, zlval* k, zlval* v, unsigned long seq);
+/* seq must be in t */
+zlhamt* zlhamt_order_rm(zlhamt* t, int shift, unsigned long seq);
+
+typedef void (*zlhamt_visitor)(const zlhamt_entry* x, void* data);
+/* calls f on every entry of an order trie, in insertion order */
+void zlhamt_each(const zlhamt* t, zlhamt_visitor f, void* data);
+
+#endif
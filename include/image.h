@@ -0,0 +1,47 @@
+#ifndef ZL_IMAGE_H
+#define ZL_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+/* Build with -DSPOW_IMAGES=0 to always read imported files from source */
+#ifndef SPOW_IMAGES
+#define SPOW_IMAGES 1
+#endif
+
+/* Images cache the forms read from a source file in a compact binary
+ * form, saved next to it under its name with a 'c' appended (so
+ * helpers/core.zlc for helpers/core.zl). An image records the interpreter
+ * version and the size and hash of the source it was made from, and is
+ * only used while they all still match; one that doesn't check out is
+ * ignored and written again */
+typedef struct zlimage zlimage;
+typedef struct zlimage_writer zlimage_writer;
+
+/* the image of file, whose contents are source, or NULL if there is no
+ * valid one */
+zlimage* zlimage_open(const char* file, const char* source, size_t size);
+/* 1 and the next form in v, 0 after the last */
+int zlimage_next(zlimage* img, zlval** v, char** err);
+void zlimage_close(zlimage* img);
+
+/* an image of file, whose contents are source, to be written form by form
+ * as they are read; NULL if it can't be written there */
+zlimage_writer* zlimage_create(const char* file, const char* source, size_t size);
+void zlimage_write(zlimage_writer* w, const zlval* v);
+/* saves the image if all forms were written, or drops it otherwise */
+void zlimage_finish(zlimage_writer* w, bool save);
+
+/* Snapshots hold a whole top level environment, from the builtins to
+ * everything the functions defined in it close over, so it can be set up
+ * again from one mapped file rather than by registering the builtins and
+ * running the prelude. Like images they are only read by the version that
+ * wrote them */
+bool zlsnapshot_save(const char* file, zlenv* e);
+/* the top level environment saved in file, or NULL if there is no valid
+ * snapshot there */
+zlenv* zlsnapshot_load(const char* file);
+
+#endif
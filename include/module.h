@@ -0,0 +1,39 @@
+#ifndef ZL_MODULE_H
+#define ZL_MODULE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "types.h"
+
+/* Imports are found by name, first as given and then in each directory of
+ * the search path: those listed in SPOW_PATH, separated by colons, and then
+ * the helpers directory of the installation. In each place the name is
+ * tried with the .spow and .zl extensions before it is tried as it is.
+ *
+ * Each file is imported once per interpreter. The registry keeps files by
+ * their canonical path and the modification time they had when they were
+ * imported, and only imports them again once they have changed */
+
+/* the canonical path of the file imported as name, or NULL and the reason
+ * in err */
+char* zlmodule_resolve(const char* name, zlval** err);
+/* marks path as imported, or returns false if it already was since it
+ * last changed; it is marked before it runs, so cyclic imports stop */
+bool zlmodule_claim(const char* path);
+/* unmarks path after an import that failed, so the next one runs it */
+void zlmodule_forget(const char* path);
+
+/* The registry is saved along with an environment its files were imported
+ * into, and filled in again when that environment is restored, so they
+ * aren't run a second time over what they already defined */
+typedef void (*zlmodule_entry_fn)(const char* path, const struct timespec* mtime, void* data);
+int zlmodule_count(void);
+/* calls f with each imported file and the modification time it had */
+void zlmodule_export(zlmodule_entry_fn f, void* data);
+/* marks path as imported when its modification time was mtime */
+void zlmodule_restore(const char* path, const struct timespec* mtime);
+
+void zlmodule_teardown(void);
+
+#endif
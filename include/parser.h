@@ -5,10 +5,18 @@
 
 #include "types.h"
 
-void setup_parser(void);
-void teardown_parser(void);
+typedef struct zlreader zlreader;
 
+/* every form of input, in an S-Expression */
 bool zlval_parse(const char* input, zlval** v, char** err);
-bool zlval_parse_file(const char* file, zlval** v, char** err);
+
+/* Reads the forms of a file one at a time, keeping only the one being read
+ * in memory. zlreader_next gives 1 and the next form in v, 0 at the end of
+ * the file or -1 and a message in err for syntax errors. With cache, the
+ * forms of a regular file are read from its image, or saved to one (see
+ * image.h) */
+zlreader* zlreader_open(const char* file, bool cache, char** err);
+int zlreader_next(zlreader* r, zlval** v, char** err);
+void zlreader_close(zlreader* r);
 
 #endif
@@ -0,0 +1,25 @@
+#ifndef ZL_POOL_H
+#define ZL_POOL_H
+
+#include <stddef.h>
+
+/* Build with -DSPOW_POOL=0 to allocate every node with plain malloc */
+#ifndef SPOW_POOL
+#define SPOW_POOL 1
+#endif
+
+typedef struct {
+    long live;
+    long peak;
+    long allocs;
+    /* slabs carved into size classes, and how many objects they hold */
+    long slabs;
+    long capacity;
+} zlpool_stats;
+
+void* zlpool_alloc(size_t size);
+void zlpool_free(void* p, size_t size);
+void zlpool_get_stats(zlpool_stats* s);
+void zlpool_teardown(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef ZL_SOURCE_H
+#define ZL_SOURCE_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+/* A source file mapped into memory. The mapping is private, so the reader
+ * can end string literals in place by writing a NUL over their closing
+ * quote, and the strings read from it point into it rather than being
+ * copied. Each of them holds a reference, so it stays mapped until the
+ * last is gone */
+struct zlsource {
+    int references;
+    char* base;
+    size_t size;
+};
+
+/* NULL if fd can't be mapped, as for pipes and empty files */
+zlsource* zlsource_map(int fd);
+/* Reading a page of a file that has since been cut short faults, so once
+ * the reader is done with a source that strings still point into, they are
+ * moved off the file. Until then, truncating a file being imported (as
+ * editors saving over it may) stops the interpreter with SIGBUS */
+void zlsource_detach(zlsource* s);
+zlsource* zlsource_retain(zlsource* s);
+void zlsource_release(zlsource* s);
+
+#endif
@@ -3,17 +3,49 @@
 
 #include <stdbool.h>
 
+#include "bigint.h"
 #include "dict.h"
 
 struct zlval;
 struct zlenv;
+struct zlchunk;
 typedef struct zlval zlval;
 typedef struct zlenv zlenv;
+typedef struct zlchunk zlchunk;
+typedef struct zlproto zlproto;
+typedef struct zlhamt zlhamt;
+typedef struct zlsource zlsource;
+
+/* scratch state of the cycle collector, kept on everything it traces */
+typedef enum {
+    ZLGC_UNSEEN,
+    ZLGC_SEEN,
+    ZLGC_REACHABLE
+} zlgc_state_t;
+
+/* cell storage of collections; values sharing it each view count cells
+ * from their own cell pointer. Slots front to back hold a reference each,
+ * and a view that ends at back (or starts at front) may claim the free slot
+ * next to it, so consing onto the newest list doesn't copy the others */
+typedef struct zlvec {
+    int references;
+    int capacity;
+    int front;
+    int back;
+
+    int gc_refs;
+    unsigned char gc_state;
+
+    zlval* slots[];
+} zlvec;
 
 /* zlval types */
 typedef enum {
     /* The order of numeric types is important */
     ZLVAL_INT,
+    /* integers that don't fit an INT, which they are always demoted to
+     * when they fit again */
+    ZLVAL_BIGINT,
     ZLVAL_FLOAT,
 
     ZLVAL_ERR,
@@ -32,7 +64,8 @@ typedef enum {
     ZLVAL_CEXPR
 } zlval_type_t;
 
-#define ISNUMERIC(t) (t == ZLVAL_INT || t == ZLVAL_FLOAT)
+#define ISNUMERIC(t) (t == ZLVAL_INT || t == ZLVAL_BIGINT || t == ZLVAL_FLOAT)
+#define ISINTEGER(t) (t == ZLVAL_INT || t == ZLVAL_BIGINT)
 #define ISORDEREDCOLLECTION(t) (t == ZLVAL_QEXPR || t == ZLVAL_STR || t == ZLVAL_QSYM)
 #define ISCOLLECTION(t) (t == ZLVAL_QEXPR || t == ZLVAL_STR || t == ZLVAL_QSYM || t == ZLVAL_DICT)
 #define ISEXPR(t) (t == ZLVAL_QEXPR || t == ZLVAL_SEXPR)
@@ -47,56 +80,156 @@ typedef zlval*(*zlbuiltin)(zlenv*, zlval*);
 
 struct zlval {
     zlval_type_t type;
+
+    /* copies share the value; it is cloned by zlval_unshare before being
+     * changed in place */
+    int references;
+    int gc_refs;
+
     int count;
     zlval** cell;
 
+    /* the storage cell points into */
+    zlvec* vec;
+
     /* collection types have length */
     int length;
 
+    /* set on args whose cells the VM has already evaluated */
+    bool evaluated;
+
+    /* set on collections known to hold no E- or C-Expressions at any depth,
+     * so evaluating them as Q-Expressions leaves them as they are */
+    bool plain;
+
+    unsigned char gc_state;
+
     union {
         /* basic types */
         char* err;
         long lng;
+        zlbigint* big;
         double dbl;
-        char* sym;
-        char* str;
         bool bln;
 
-        /* dict type */
-        dict* d;
+        /* string type; str points into source if it was read from a mapped
+         * file, and was allocated for the value otherwise */
+        struct {
+            char* str;
+            zlsource* source;
+        };
+
+        /* symbol types; sym is the name of the atom */
+        struct {
+            char* sym;
+            zlatom* atom;
+        };
+
+        /* dict type; seq numbers the next new key, and order holds the
+         * entries again by seq, for walking them in insertion order */
+        struct {
+            zlhamt* map;
+            unsigned long seq;
+            zlhamt* order;
+            int order_shift;
+        };
 
         /* function types */
         struct {
             zlbuiltin builtin;
             char* builtin_name;
+            /* arg counts it accepts; max_args -1 for no limit */
+            int min_args;
+            int max_args;
         };
         struct {
             zlenv* env;
-            zlval* formals;
-            zlval* body;
+            zlproto* proto;
+            /* formals bound so far, by partial application */
+            int bound;
             bool called;
         };
+
+        /* expression types; a form that calls a macro keeps what it
+         * expanded to, for as long as the same macro is called from it */
+        struct {
+            zlval* expansion;
+            zlval* expanded_by;
+        };
     };
 };
 
+/* the code of a function or macro, shared by every copy of it; copies
+ * only differ in their frame and how many formals they have bound */
+struct zlproto {
+    int references;
+    zlval* formals;
+    zlval* body;
+    zlchunk* chunk;
+
+    /* formals before '&', which binds the remaining args if variadic */
+    int arity;
+    bool variadic;
+
+    /* times a macro's body has been evaluated to expand a call */
+    int expansions;
+};
+
+/* names of the lexically addressed locals of a frame, shared by every
+ * frame created from the same function or let */
+typedef struct zlscope {
+    int count;
+    zlatom** names;
+    int references;
+} zlscope;
+
+/* frames with at most this many locals don't allocate their slots */
+#define ZLENV_INLINE_SLOTS 8
+
 struct zlenv {
     zlenv* parent;
+    /* names defined at runtime, NULL until the first one */
     dict* internal_dict;
+
+    /* locals bound to the names in scope, NULL until bound; small frames
+     * keep them in inline_slots */
+    zlscope* scope;
+    zlval** slots;
+    zlval* inline_slots[ZLENV_INLINE_SLOTS];
+
     bool top_level;
     int references;
+
+    /* every live environment is linked in for the cycle collector */
+    zlenv* gc_prev;
+    zlenv* gc_next;
+    int gc_refs;
+    unsigned char gc_state;
 };
 
 /* zlval instantiation functions */
 zlval* zlval_err(const char* fmt, ...);
 zlval* zlval_int(long x);
+zlval* zlval_bigint(zlbigint* x);
 zlval* zlval_float(double x);
 zlval* zlval_sym(const char* s);
 zlval* zlval_qsym(const char* s);
 zlval* zlval_str(const char* s);
+/* a string taking over the length chars at s, which end in a NUL; s points
+ * into source, or was allocated with malloc if source is NULL */
+zlval* zlval_str_take(char* s, int length, zlsource* source);
+/* symbols named by the length chars at s, which need not end there */
+zlval* zlval_sym_len(const char* s, int length);
+zlval* zlval_qsym_len(const char* s, int length);
+zlval* zlval_sym_atom(zlatom* atom);
+zlval* zlval_qsym_atom(zlatom* atom);
 zlval* zlval_bool(bool b);
 zlval* zlval_fun(const zlbuiltin builtin, const char* builtin_name);
 zlval* zlval_lambda(zlenv* closure, zlval* formals, zlval* body);
 zlval* zlval_macro(zlenv* closure, zlval* formals, zlval* body);
+/* a function or macro of type running in frame, rather than a new frame
+ * of closure */
+zlval* zlval_lambda_frame(zlval_type_t type, zlenv* frame, zlval* formals, zlval* body);
 zlval* zlval_dict(void);
 zlval* zlval_sexpr(void);
 zlval* zlval_qexpr(void);
@@ -107,6 +240,9 @@ zlval* zlval_cexpr(void);
 void zlval_del(zlval* v);
 zlval* zlval_add(zlval* v, zlval* x);
 zlval* zlval_add_front(zlval* v, zlval* x);
+/* makes room for n more cells at the back of v, so adding them doesn't
+ * move the ones already there */
+zlval* zlval_reserve(zlval* v, int n);
 
 zlval* zlval_add_dict(zlval* x, zlval* k, zlval* v);
 zlval* zlval_get_dict(zlval* x, zlval* k);
@@ -123,28 +259,50 @@ zlval* zlval_shift(zlval* x, zlval* y, int i);
 zlval* zlval_reverse(zlval* x);
 zlval* zlval_slice(zlval* x, int start, int end);
 zlval* zlval_slice_step(zlval* x, int start, int end, int step);
+double zlval_to_double(const zlval* x);
 void zlval_maybe_promote_numeric(zlval* a, zlval* b);
 void zlval_promote_numeric(zlval* a);
 void zlval_demote_numeric(zlval* a);
 zlval* zlval_copy(const zlval* v);
+zlval* zlval_unshare(zlval* v);
+zlval* zlval_unbound_formals(const zlval* f);
+/* keeps x as the expansion of the call to macro m made by the form site */
+void zlval_set_expansion(zlval* site, zlval* m, zlval* x);
+bool zlval_is_plain(const zlval* v);
 zlval* zlval_convert(zlval_type_t t, const zlval* v);
 bool zlval_eq(zlval* x, zlval* y);
+bool zlval_hashable(const zlval* v);
+unsigned int zlval_hash(const zlval* v);
 
 /* zlval utility functions */
 bool is_zlval_empty_qexpr(zlval* x);
 
+/* zlscope functions */
+zlscope* zlscope_new(void);
+zlscope* zlscope_retain(zlscope* s);
+void zlscope_release(zlscope* s);
+void zlscope_add(zlscope* s, zlatom* name);
+int zlscope_index(const zlscope* s, const zlatom* name);
+
 /* zlenv functions */
 zlenv* zlenv_new(void);
+zlenv* zlenv_new_frame(zlscope* s);
 zlenv* zlenv_new_top_level(void);
 void zlenv_del(zlenv* e);
 void zlenv_del_top_level(zlenv* e);
+void zlenv_clear(zlenv* e);
 int zlenv_index(zlenv* e, zlval* k);
 zlval* zlenv_get(zlenv* e, zlval* k);
+zlval* zlenv_get_slot(zlenv* e, zlval* k, int depth, int slot);
 void zlenv_put(zlenv* e, zlval* k, zlval* v);
 void zlenv_put_global(zlenv* e, zlval* k, zlval* v);
 zlenv* zlenv_copy(zlenv* e);
 
-void zlenv_add_builtin(zlenv* e, char* name, zlbuiltin func);
+void zlenv_add_builtin(zlenv* e, const char* name, zlbuiltin func);
 void zlenv_add_builtins(zlenv* e);
+/* the builtin bound to name by zlenv_add_builtins, or NULL */
+zlbuiltin zlbuiltin_lookup(const char* name);
+/* the arg counts builtin accepts, or 0 and -1 if it is not one of them */
+void zlbuiltin_arity(zlbuiltin builtin, int* min_args, int* max_args);
 
 #endif
\ No newline at end of file
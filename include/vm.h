@@ -0,0 +1,17 @@
+#ifndef ZL_VM_H
+#define ZL_VM_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Build with -DSPOW_VM=0 to evaluate everything with the tree walker */
+#ifndef SPOW_VM
+#define SPOW_VM 1
+#endif
+
+zlchunk* zlvm_load(zlval* f);
+zlval* zlvm_exec(zlenv** e, zlchunk* c, bool* pending);
+void zlvm_teardown(void);
+
+#endif
@@ -0,0 +1,84 @@
+#include "../include/atom.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/util.h"
+
+#define ATOM_TABLE_INITIAL_SIZE 256
+#define ATOM_TABLE_LOAD_FACTOR 0.5
+#define ATOM_TABLE_GROWTH_FACTOR 2
+
+static zlatom** table = NULL;
+static int table_size = 0;
+static int table_count = 0;
+
+static unsigned int atom_hash(const char* str, int length) {
+    /* djb2 hash */
+    unsigned int hash = 5381;
+    for (int i = 0; i < length; i++) {
+        /* XOR hash * 33 with current char val */
+        hash = ((hash << 5) + hash) ^ str[i];
+    }
+    return hash;
+}
+
+static int atom_findslot(zlatom** t, int size, const char* name, int length, unsigned int hash) {
+    /* linear probing; size is a power of two */
+    int i = hash & (size - 1);
+    while (t[i] && (t[i]->hash != hash || t[i]->length != length || memcmp(t[i]->name, name, length))) {
+        i = (i + 1) & (size - 1);
+    }
+    return i;
+}
+
+static void atom_table_resize(void) {
+    int size = table_size ? table_size * ATOM_TABLE_GROWTH_FACTOR : ATOM_TABLE_INITIAL_SIZE;
+    zlatom** t = safe_malloc(sizeof(zlatom*) * size);
+    for (int i = 0; i < size; i++) {
+        t[i] = NULL;
+    }
+
+    for (int i = 0; i < table_size; i++) {
+        if (table[i]) {
+            t[atom_findslot(t, size, table[i]->name, table[i]->length, table[i]->hash)] = table[i];
+        }
+    }
+
+    free(table);
+    table = t;
+    table_size = size;
+}
+
+zlatom* zlatom_intern(const char* name) {
+    return zlatom_intern_len(name, strlen(name));
+}
+
+zlatom* zlatom_intern_len(const char* name, int length) {
+    if (table_count + 1 > table_size * ATOM_TABLE_LOAD_FACTOR) {
+        atom_table_resize();
+    }
+
+    unsigned int hash = atom_hash(name, length);
+    int i = atom_findslot(table, table_size, name, length, hash);
+    if (!table[i]) {
+        zlatom* a = safe_malloc(sizeof(zlatom) + length + 1);
+        a->hash = hash;
+        a->length = length;
+        memcpy(a->name, name, length);
+        a->name[length] = '\0';
+
+        table[i] = a;
+        table_count++;
+    }
+    return table[i];
+}
+
+void zlatom_teardown(void) {
+    for (int i = 0; i < table_size; i++) {
+        free(table[i]);
+    }
+    free(table);
+    table = NULL;
+    table_size = table_count = 0;
+}
@@ -0,0 +1,553 @@
+#include "../include/bigint.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/util.h"
+
+#define LIMB_BASE 4294967296.0
+#define LIMB_RADIX ((uint64_t)1 << 32)
+
+/* below this many limbs schoolbook multiplication beats splitting */
+#define KARATSUBA_THRESHOLD 32
+
+/* decimal digits converted per pass over the limbs */
+#define DECIMAL_CHUNK 1000000000u
+#define DECIMAL_CHUNK_DIGITS 9
+
+static zlbigint* bigint_new(int count) {
+    zlbigint* a = safe_malloc(sizeof(zlbigint) + sizeof(uint32_t) * (count > 0 ? count : 1));
+    a->count = count;
+    a->negative = false;
+    memset(a->limbs, 0, sizeof(uint32_t) * count);
+    return a;
+}
+
+static int mag_trim(const uint32_t* x, int n) {
+    while (n > 0 && x[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+static zlbigint* bigint_trim(zlbigint* a) {
+    a->count = mag_trim(a->limbs, a->count);
+    if (a->count == 0) {
+        a->negative = false;
+    }
+    return a;
+}
+
+/* The mag_ functions work on magnitudes, which may carry leading zero
+ * limbs while being worked on */
+static int mag_cmp(const uint32_t* a, int an, const uint32_t* b, int bn) {
+    an = mag_trim(a, an);
+    bn = mag_trim(b, bn);
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    for (int i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* r = a + b for an >= bn; r has room for an + 1 limbs */
+static int mag_add(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    uint64_t carry = 0;
+    int i;
+    for (i = 0; i < bn; i++) {
+        carry += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (; i < an; i++) {
+        carry += a[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    r[i] = (uint32_t)carry;
+    return mag_trim(r, an + 1);
+}
+
+/* r = a - b for a >= b */
+static int mag_sub(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    int64_t borrow = 0;
+    int i;
+    for (i = 0; i < bn; i++) {
+        int64_t d = (int64_t)a[i] - b[i] - borrow;
+        borrow = d < 0;
+        r[i] = (uint32_t)d;
+    }
+    for (; i < an; i++) {
+        int64_t d = (int64_t)a[i] - borrow;
+        borrow = d < 0;
+        r[i] = (uint32_t)d;
+    }
+    return mag_trim(r, an);
+}
+
+/* r += x shifted up by shift limbs; r has room for the result */
+static void mag_add_at(uint32_t* r, int rn, const uint32_t* x, int xn, int shift) {
+    uint64_t carry = 0;
+    int i;
+    for (i = 0; i < xn; i++) {
+        carry += (uint64_t)r[shift + i] + x[i];
+        r[shift + i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (i += shift; carry && i < rn; i++) {
+        carry += r[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+/* r -= x, which is known not to be larger */
+static void mag_sub_from(uint32_t* r, int rn, const uint32_t* x, int xn) {
+    int64_t borrow = 0;
+    int i;
+    for (i = 0; i < xn; i++) {
+        int64_t d = (int64_t)r[i] - x[i] - borrow;
+        borrow = d < 0;
+        r[i] = (uint32_t)d;
+    }
+    for (; borrow && i < rn; i++) {
+        int64_t d = (int64_t)r[i] - borrow;
+        borrow = d < 0;
+        r[i] = (uint32_t)d;
+    }
+}
+
+static void mag_mul_school(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < bn; j++) {
+            carry += (uint64_t)a[i] * b[j] + r[i + j];
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r[i + bn] = (uint32_t)carry;
+    }
+}
+
+/* r = a * b, filling all an + bn limbs of r */
+static void mag_mul(uint32_t* r, const uint32_t* a, int an, const uint32_t* b, int bn) {
+    if (an < bn) {
+        const uint32_t* t = a;
+        a = b;
+        b = t;
+        int tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+
+    /* split a = a1 B^m + a0, and b likewise when it is long enough */
+    int m = an / 2;
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+
+    if (bn <= m) {
+        uint32_t* t = safe_malloc(sizeof(uint32_t) * (an - m + bn));
+        mag_mul(t, a, m, b, bn);
+        mag_add_at(r, an + bn, t, m + bn, 0);
+        mag_mul(t, a + m, an - m, b, bn);
+        mag_add_at(r, an + bn, t, an - m + bn, m);
+        free(t);
+        return;
+    }
+
+    /* Karatsuba: with z0 = a0 b0 and z2 = a1 b1, the middle term
+     * a0 b1 + a1 b0 is (a0 + a1)(b0 + b1) - z0 - z2, which takes three
+     * half size products instead of four */
+    int a1n = an - m;
+    int b1n = bn - m;
+    uint32_t* z0 = r;
+    uint32_t* z2 = r + 2 * m;
+    mag_mul(z0, a, m, b, m);
+    mag_mul(z2, a + m, a1n, b + m, b1n);
+
+    int san = a1n + 1;
+    int sbn = (b1n > m ? b1n : m) + 1;
+    uint32_t* sa = safe_malloc(sizeof(uint32_t) * (san + sbn));
+    uint32_t* sb = sa + san;
+    mag_add(sa, a + m, a1n, a, m);
+    if (b1n > m) {
+        mag_add(sb, b + m, b1n, b, m);
+    } else {
+        mag_add(sb, b, m, b + m, b1n);
+    }
+
+    int z1n = san + sbn;
+    uint32_t* z1 = safe_malloc(sizeof(uint32_t) * z1n);
+    mag_mul(z1, sa, san, sb, sbn);
+    mag_sub_from(z1, z1n, z0, 2 * m);
+    mag_sub_from(z1, z1n, z2, a1n + b1n);
+    mag_add_at(r, an + bn, z1, mag_trim(z1, z1n), m);
+
+    free(z1);
+    free(sa);
+}
+
+/* x = x * mul + add, growing x into capacity it is known to have */
+static void mag_mul_add_small(zlbigint* x, uint32_t mul, uint32_t add) {
+    uint64_t carry = add;
+    for (int i = 0; i < x->count; i++) {
+        carry += (uint64_t)x->limbs[i] * mul;
+        x->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) {
+        x->limbs[x->count++] = (uint32_t)carry;
+    }
+}
+
+/* q = a / d, returning the remainder; q may alias a */
+static uint32_t mag_div_small(uint32_t* q, const uint32_t* a, int an, uint32_t d) {
+    uint64_t rem = 0;
+    for (int i = an - 1; i >= 0; i--) {
+        uint64_t cur = (rem << 32) | a[i];
+        q[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    return (uint32_t)rem;
+}
+
+zlbigint* zlbigint_from_long(long x) {
+    uint64_t m = x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+    zlbigint* a = bigint_new(2);
+    a->limbs[0] = (uint32_t)m;
+    a->limbs[1] = (uint32_t)(m >> 32);
+    a->negative = x < 0;
+    return bigint_trim(a);
+}
+
+zlbigint* zlbigint_from_double(double x) {
+    /* truncates; x must be finite */
+    x = trunc(x);
+    bool negative = x < 0;
+    x = fabs(x);
+
+    int e;
+    frexp(x, &e);
+    zlbigint* a = bigint_new(e > 0 ? e / 32 + 1 : 1);
+    for (int i = 0; i < a->count; i++) {
+        a->limbs[i] = (uint32_t)fmod(x, LIMB_BASE);
+        x = floor(x / LIMB_BASE);
+    }
+    a->negative = negative;
+    return bigint_trim(a);
+}
+
+zlbigint* zlbigint_parse(const char* s) {
+    /* decimal with an optional sign; NULL unless all of s is a number */
+    bool negative = *s == '-';
+    if (*s == '-' || *s == '+') {
+        s++;
+    }
+    int digits = strlen(s);
+    if (digits == 0) {
+        return NULL;
+    }
+    for (int i = 0; i < digits; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return NULL;
+        }
+    }
+
+    /* a chunk of decimal digits always fits in less than a limb */
+    zlbigint* a = bigint_new(digits / DECIMAL_CHUNK_DIGITS + 2);
+    a->count = 0;
+
+    int chunk = digits % DECIMAL_CHUNK_DIGITS;
+    if (chunk == 0) {
+        chunk = DECIMAL_CHUNK_DIGITS;
+    }
+    while (*s) {
+        uint32_t mul = 1;
+        uint32_t add = 0;
+        for (int i = 0; i < chunk; i++) {
+            mul *= 10;
+            add = add * 10 + (*s++ - '0');
+        }
+        mag_mul_add_small(a, mul, add);
+        chunk = DECIMAL_CHUNK_DIGITS;
+    }
+
+    a->negative = negative;
+    return bigint_trim(a);
+}
+
+zlbigint* zlbigint_copy(const zlbigint* a) {
+    zlbigint* x = bigint_new(a->count);
+    memcpy(x->limbs, a->limbs, sizeof(uint32_t) * a->count);
+    x->negative = a->negative;
+    return x;
+}
+
+bool zlbigint_to_long(const zlbigint* a, long* x) {
+    if (a->count > 2) {
+        return false;
+    }
+    uint64_t m = 0;
+    for (int i = a->count - 1; i >= 0; i--) {
+        m = (m << 32) | a->limbs[i];
+    }
+
+    uint64_t max = (uint64_t)LONG_MAX;
+    if (!a->negative) {
+        if (m > max) {
+            return false;
+        }
+        *x = (long)m;
+    } else {
+        if (m > max + 1) {
+            return false;
+        }
+        *x = m == max + 1 ? LONG_MIN : -(long)m;
+    }
+    return true;
+}
+
+double zlbigint_to_double(const zlbigint* a) {
+    double x = 0;
+    for (int i = a->count - 1; i >= 0; i--) {
+        x = x * LIMB_BASE + a->limbs[i];
+    }
+    return a->negative ? -x : x;
+}
+
+char* zlbigint_to_str(const zlbigint* a) {
+    /* split off chunks of decimal digits, least significant first */
+    int n = a->count;
+    uint32_t* t = safe_malloc(sizeof(uint32_t) * (n > 0 ? n : 1));
+    memcpy(t, a->limbs, sizeof(uint32_t) * n);
+
+    int max_chunks = n * 32 / 29 + 1;
+    uint32_t* chunks = safe_malloc(sizeof(uint32_t) * max_chunks);
+    int count = 0;
+    do {
+        /* mag_div_small, with a divisor the compiler can see */
+        uint64_t rem = 0;
+        for (int i = n - 1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | t[i];
+            t[i] = (uint32_t)(cur / DECIMAL_CHUNK);
+            rem = cur % DECIMAL_CHUNK;
+        }
+        chunks[count++] = (uint32_t)rem;
+        n = mag_trim(t, n);
+    } while (n > 0);
+
+    char* str = safe_malloc(count * DECIMAL_CHUNK_DIGITS + 2);
+    char* p = str;
+    if (a->negative) {
+        *p++ = '-';
+    }
+    p += sprintf(p, "%u", (unsigned)chunks[count - 1]);
+    for (int i = count - 2; i >= 0; i--) {
+        p += sprintf(p, "%09u", (unsigned)chunks[i]);
+    }
+
+    free(chunks);
+    free(t);
+    return str;
+}
+
+int zlbigint_cmp(const zlbigint* a, const zlbigint* b) {
+    if (a->negative != b->negative) {
+        return a->negative ? -1 : 1;
+    }
+    int c = mag_cmp(a->limbs, a->count, b->limbs, b->count);
+    return a->negative ? -c : c;
+}
+
+zlbigint* zlbigint_neg(const zlbigint* a) {
+    zlbigint* x = zlbigint_copy(a);
+    x->negative = !a->negative && a->count > 0;
+    return x;
+}
+
+static zlbigint* bigint_add_signed(const zlbigint* a, const zlbigint* b, bool b_negative) {
+    if (a->count < b->count) {
+        /* a + b = b + a, and a - b = -(b - a) */
+        if (b_negative == b->negative) {
+            return bigint_add_signed(b, a, a->negative);
+        }
+        zlbigint* x = bigint_add_signed(b, a, !a->negative);
+        x->negative = !x->negative && x->count > 0;
+        return x;
+    }
+
+    zlbigint* x = bigint_new(a->count + 1);
+    if (a->negative == b_negative) {
+        x->count = mag_add(x->limbs, a->limbs, a->count, b->limbs, b->count);
+        x->negative = a->negative;
+    } else if (mag_cmp(a->limbs, a->count, b->limbs, b->count) >= 0) {
+        x->count = mag_sub(x->limbs, a->limbs, a->count, b->limbs, b->count);
+        x->negative = a->negative;
+    } else {
+        x->count = mag_sub(x->limbs, b->limbs, b->count, a->limbs, a->count);
+        x->negative = b_negative;
+    }
+    return bigint_trim(x);
+}
+
+zlbigint* zlbigint_add(const zlbigint* a, const zlbigint* b) {
+    return bigint_add_signed(a, b, b->negative);
+}
+
+zlbigint* zlbigint_sub(const zlbigint* a, const zlbigint* b) {
+    return bigint_add_signed(a, b, !b->negative);
+}
+
+zlbigint* zlbigint_mul(const zlbigint* a, const zlbigint* b) {
+    if (a->count == 0 || b->count == 0) {
+        return bigint_new(0);
+    }
+    if (a->count > ZLBIGINT_MAX_LIMBS - b->count) {
+        return NULL;
+    }
+    zlbigint* x = bigint_new(a->count + b->count);
+    mag_mul(x->limbs, a->limbs, a->count, b->limbs, b->count);
+    x->negative = a->negative != b->negative;
+    return bigint_trim(x);
+}
+
+static void mag_divmod(uint32_t* q, uint32_t* r, const uint32_t* a, int m, const uint32_t* b, int n) {
+    /* Long division of an m limb a by an n limb b, for m >= n >= 2 (Knuth,
+     * TAOCP vol. 2, algorithm D). Both are shifted so b's top bit is set,
+     * which keeps each estimated quotient limb at most two too large */
+    int s = 0;
+    for (uint32_t top = b[n - 1]; !(top & 0x80000000u); top <<= 1) {
+        s++;
+    }
+
+    uint32_t* vn = safe_malloc(sizeof(uint32_t) * (n + m + 1));
+    uint32_t* un = vn + n;
+    for (int i = n - 1; i > 0; i--) {
+        vn[i] = (b[i] << s) | (uint32_t)((uint64_t)b[i - 1] >> (32 - s));
+    }
+    vn[0] = b[0] << s;
+    un[m] = (uint32_t)((uint64_t)a[m - 1] >> (32 - s));
+    for (int i = m - 1; i > 0; i--) {
+        un[i] = (a[i] << s) | (uint32_t)((uint64_t)a[i - 1] >> (32 - s));
+    }
+    un[0] = a[0] << s;
+
+    for (int j = m - n; j >= 0; j--) {
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= LIMB_RADIX || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= LIMB_RADIX) {
+                break;
+            }
+        }
+
+        int64_t borrow = 0;
+        int64_t t;
+        for (int i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - borrow - (int64_t)(p & 0xffffffffu);
+            un[i + j] = (uint32_t)t;
+            borrow = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - borrow;
+        un[j + n] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+        if (t < 0) {
+            /* the estimate was one too large; add b back */
+            q[j]--;
+            uint64_t carry = 0;
+            for (int i = 0; i < n; i++) {
+                carry += (uint64_t)un[i + j] + vn[i];
+                un[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            un[j + n] += (uint32_t)carry;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        r[i] = (un[i] >> s) | (uint32_t)((uint64_t)un[i + 1] << (32 - s));
+    }
+    free(vn);
+}
+
+zlbigint* zlbigint_divmod(const zlbigint* a, const zlbigint* b, zlbigint** rem) {
+    /* truncating division, so the remainder takes the sign of a; b must
+     * not be zero */
+    if (mag_cmp(a->limbs, a->count, b->limbs, b->count) < 0) {
+        *rem = zlbigint_copy(a);
+        return bigint_new(0);
+    }
+
+    zlbigint* q = bigint_new(a->count);
+    zlbigint* r = bigint_new(b->count);
+    if (b->count == 1) {
+        r->limbs[0] = mag_div_small(q->limbs, a->limbs, a->count, b->limbs[0]);
+    } else {
+        mag_divmod(q->limbs, r->limbs, a->limbs, a->count, b->limbs, b->count);
+    }
+    q->negative = a->negative != b->negative;
+    r->negative = a->negative;
+
+    *rem = bigint_trim(r);
+    return bigint_trim(q);
+}
+
+static int bigint_bits(const zlbigint* a) {
+    if (a->count == 0) {
+        return 0;
+    }
+    int bits = (a->count - 1) * 32;
+    for (uint32_t top = a->limbs[a->count - 1]; top; top >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+zlbigint* zlbigint_pow(const zlbigint* a, unsigned long n) {
+    /* a^n has more than n (bits - 1) bits, so a result that is sure to be
+     * too long is turned down before any of it is worked out; 0, 1 and -1
+     * stay small whatever n is */
+    int bits = bigint_bits(a);
+    if (bits > 1 && n > (unsigned long)ZLBIGINT_MAX_LIMBS * 32 / (bits - 1)) {
+        return NULL;
+    }
+
+    /* exponentiation by squaring */
+    zlbigint* x = zlbigint_from_long(1);
+    zlbigint* base = zlbigint_copy(a);
+    while (n > 0) {
+        if (n & 1) {
+            zlbigint* t = zlbigint_mul(x, base);
+            free(x);
+            x = t;
+        }
+        n >>= 1;
+        if (n > 0 && x) {
+            zlbigint* t = zlbigint_mul(base, base);
+            free(base);
+            base = t;
+        }
+        if (!x || !base) {
+            free(x);
+            free(base);
+            return NULL;
+        }
+    }
+    free(base);
+    return x;
+}
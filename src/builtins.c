@@ -3,14 +3,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <string.h>
 #include <math.h>
-#include <sys/stat.h>
 
 #include "../include/assert.h"
+#include "../include/bigint.h"
 #include "../include/eval.h"
+#include "../include/gc.h"
+#include "../include/module.h"
 #include "../include/parser.h"
+#include "../include/pool.h"
 #include "../include/print.h"
 #include "../include/repl.h"
 #include "../include/util.h"
@@ -27,18 +31,6 @@
     } \
 }
 
-#define BINARY_OP(a, b, op) { \
-    switch (a->type) { \
-        case ZLVAL_INT: \
-            a->lng = a->lng op b->lng; \
-            break; \
-        case ZLVAL_FLOAT: \
-            a->dbl = a->dbl op b->dbl; \
-            break; \
-        default: break; \
-    } \
-}
-
 #define BINARY_OP_RES(res, a, b, op) { \
     switch (a->type) { \
         case ZLVAL_INT: \
@@ -73,91 +65,305 @@ double fmodulo(double x, double y) {
     return fmod(fabs(x), fabs(y));
 }
 
-zlval* builtin_num_op(zlenv* e, zlval* a, char* op) {
+/* Integer kernels compute x op y into r, returning false when the result
+ * is not an exact integer or does not fit, which the generic kernel of the
+ * operator then deals with */
+static bool fixnum_add(long x, long y, long* r) {
+    return !__builtin_add_overflow(x, y, r);
+}
+
+static bool fixnum_sub(long x, long y, long* r) {
+    return !__builtin_sub_overflow(x, y, r);
+}
+
+static bool fixnum_mul(long x, long y, long* r) {
+    return !__builtin_mul_overflow(x, y, r);
+}
+
+static bool fixnum_div(long x, long y, long* r) {
+    if (y == 0 || (y == -1 && x == LONG_MIN) || x % y != 0) {
+        return false;
+    }
+    *r = x / y;
+    return true;
+}
+
+static bool fixnum_trunc_div(long x, long y, long* r) {
+    if (y == 0 || (y == -1 && x == LONG_MIN)) {
+        return false;
+    }
+    *r = x / y;
+    return true;
+}
+
+static bool fixnum_mod(long x, long y, long* r) {
+    if (y == 0 || x == LONG_MIN || y == LONG_MIN) {
+        return false;
+    }
+    *r = modulo(x, y);
+    return true;
+}
+
+static bool fixnum_pow(long x, long y, long* r) {
+    /* Exponentiation by squaring; negative powers are mostly fractional */
+    if (y < 0) {
+        return false;
+    }
+    long res = 1;
+    while (y > 0) {
+        if ((y & 1) && __builtin_mul_overflow(res, x, &res)) {
+            return false;
+        }
+        y >>= 1;
+        if (y > 0 && __builtin_mul_overflow(x, x, &x)) {
+            return false;
+        }
+    }
+    *r = res;
+    return true;
+}
+
+/* Integer operands of the generic kernels are either INT or BIGINT; an
+ * INT is widened into tmp, which the caller frees */
+static const zlbigint* as_bigint(const zlval* v, zlbigint** tmp) {
+    *tmp = v->type == ZLVAL_INT ? zlbigint_from_long(v->lng) : NULL;
+    return *tmp ? *tmp : v->big;
+}
+
+static zlval* bigint_op(zlval* x, zlval* y, zlbigint* (*op)(const zlbigint*, const zlbigint*)) {
+    zlbigint* tx;
+    zlbigint* ty;
+    zlbigint* b = op(as_bigint(x, &tx), as_bigint(y, &ty));
+    free(tx);
+    free(ty);
+    zlval_del(x);
+    return b ? zlval_bigint(b) : zlval_err("integer result too large");
+}
+
+static zlbigint* bigint_divmod(const zlval* x, const zlval* y, zlbigint** rem) {
+    zlbigint* tx;
+    zlbigint* ty;
+    zlbigint* q = zlbigint_divmod(as_bigint(x, &tx), as_bigint(y, &ty), rem);
+    free(tx);
+    free(ty);
+    return q;
+}
+
+static int integer_cmp(const zlval* x, const zlval* y) {
+    zlbigint* tx;
+    zlbigint* ty;
+    int c = zlbigint_cmp(as_bigint(x, &tx), as_bigint(y, &ty));
+    free(tx);
+    free(ty);
+    return c;
+}
+
+static zlval* negate(zlval* x) {
+    if (x->type == ZLVAL_BIGINT || (x->type == ZLVAL_INT && x->lng == LONG_MIN)) {
+        zlbigint* t;
+        zlval* r = zlval_bigint(zlbigint_neg(as_bigint(x, &t)));
+        free(t);
+        zlval_del(x);
+        return r;
+    }
+    x = zlval_unshare(x);
+    UNARY_OP(x, -);
+    return x;
+}
+
+/* Generic kernels work on two floats or two integers, as left by
+ * zlval_maybe_promote_numeric, and return the result or an error. Integers
+ * only get here when the integer kernel gave up, so they are done exactly
+ * as bigints, and demoted again if the result fits */
+static zlval* generic_add(zlval* x, zlval* y) {
+    if (x->type == ZLVAL_FLOAT) {
+        x->dbl += y->dbl;
+        return x;
+    }
+    return bigint_op(x, y, zlbigint_add);
+}
+
+static zlval* generic_sub(zlval* x, zlval* y) {
+    if (x->type == ZLVAL_FLOAT) {
+        x->dbl -= y->dbl;
+        return x;
+    }
+    return bigint_op(x, y, zlbigint_sub);
+}
+
+static zlval* generic_mul(zlval* x, zlval* y) {
+    if (x->type == ZLVAL_FLOAT) {
+        x->dbl *= y->dbl;
+        return x;
+    }
+    return bigint_op(x, y, zlbigint_mul);
+}
+
+static bool is_zero(const zlval* y) {
+    return (y->type == ZLVAL_INT && y->lng == 0) ||
+        (y->type == ZLVAL_FLOAT && y->dbl == 0);
+}
+
+static zlval* division_by_zero(zlval* x, char* op) {
+    zlval* err;
+    if (x->type == ZLVAL_BIGINT) {
+        char* digits = zlbigint_to_str(x->big);
+        err = zlval_err("division by zero; %s %s 0", digits, op);
+        free(digits);
+    } else {
+        err = zlval_err("division by zero; %i %s 0", x->lng, op);
+    }
+    zlval_del(x);
+    return err;
+}
+
+static zlval* generic_div(zlval* x, zlval* y) {
+    if (is_zero(y)) {
+        return division_by_zero(x, "/");
+    }
+
+    /* Handle fractional integer division */
+    if (x->type == ZLVAL_INT && y->type == ZLVAL_INT && y->lng != -1 && x->lng % y->lng != 0) {
+        zlval_promote_numeric(x);
+        zlval_promote_numeric(y);
+    } else if (x->type != ZLVAL_FLOAT) {
+        zlbigint* rem;
+        zlbigint* q = bigint_divmod(x, y, &rem);
+        bool exact = rem->count == 0;
+        free(rem);
+        if (exact) {
+            zlval_del(x);
+            return zlval_bigint(q);
+        }
+        free(q);
+        zlval_promote_numeric(x);
+        zlval_promote_numeric(y);
+    }
+    x->dbl /= y->dbl;
+    return x;
+}
+
+static zlval* generic_trunc_div(zlval* x, zlval* y) {
+    if (is_zero(y)) {
+        return division_by_zero(x, "//");
+    }
+
+    if (x->type != ZLVAL_FLOAT) {
+        zlbigint* rem;
+        zlbigint* q = bigint_divmod(x, y, &rem);
+        free(rem);
+        zlval_del(x);
+        return zlval_bigint(q);
+    }
+
+    /* Truncate, but we still need to keep result a float */
+    x->dbl /= y->dbl;
+    zlval_demote_numeric(x);
+    zlval_promote_numeric(x);
+    return x;
+}
+
+static zlval* generic_mod(zlval* x, zlval* y) {
+    if (is_zero(y)) {
+        return division_by_zero(x, "%");
+    }
+
+    if (x->type == ZLVAL_FLOAT) {
+        BINARY_OP_FUNC(x, y, fmodulo);
+        return x;
+    }
+
+    /* the remainder of truncating division only differs in sign */
+    zlbigint* rem;
+    free(bigint_divmod(x, y, &rem));
+    rem->negative = false;
+    zlval_del(x);
+    return zlval_bigint(rem);
+}
+
+static zlval* generic_pow(zlval* x, zlval* y) {
+    if (x->type == ZLVAL_FLOAT) {
+        BINARY_OP_FUNC(x, y, pow);
+    } else if ((y->type == ZLVAL_INT && y->lng < 0) || (y->type == ZLVAL_BIGINT && y->big->negative)) {
+        /* Handle case where result is fractional */
+        double ans = pow(zlval_to_double(x), zlval_to_double(y));
+        zlval_del(x);
+        if (ans - (double)(long)ans != 0.0) {
+            x = zlval_float(ans);
+        } else {
+            x = zlval_int((long)ans);
+        }
+    } else if (y->type == ZLVAL_BIGINT) {
+        zlval_del(x);
+        return zlval_err("pow exponent too large");
+    } else {
+        zlbigint* t;
+        zlbigint* b = zlbigint_pow(as_bigint(x, &t), y->lng);
+        free(t);
+        zlval_del(x);
+        if (!b) {
+            return zlval_err("pow exponent too large");
+        }
+        x = zlval_bigint(b);
+    }
+
+    // Check for NaN
+    if (x->type == ZLVAL_FLOAT && isnan(x->dbl)) {
+        zlval_del(x);
+        return zlval_err("pow resulted in NaN");
+    }
+    return x;
+}
+
+struct zlnum_op {
+    char* name;
+    bool (*fixnum)(long x, long y, long* r);
+    zlval* (*generic)(zlval* x, zlval* y);
+};
+
+static const zlnum_op num_add = { "+", fixnum_add, generic_add };
+static const zlnum_op num_sub = { "-", fixnum_sub, generic_sub };
+static const zlnum_op num_mul = { "*", fixnum_mul, generic_mul };
+static const zlnum_op num_div = { "/", fixnum_div, generic_div };
+static const zlnum_op num_trunc_div = { "//", fixnum_trunc_div, generic_trunc_div };
+static const zlnum_op num_mod = { "%", fixnum_mod, generic_mod };
+static const zlnum_op num_pow = { "^", fixnum_pow, generic_pow };
+
+zlval* builtin_num_op(zlenv* e, zlval* a, const zlnum_op* op) {
     /* Argcount must be checked in calling function, because
      * different operators have different requirements */
     EVAL_ARGS(e, a);
 
     for (int i = 0; i < a->count; i++) {
-        ZLASSERT_ISNUMERIC(a, i, op);
+        ZLASSERT_ISNUMERIC(a, i, op->name);
     }
 
-    zlval* x = zlval_pop(a, 0);
-    if (streq(op, "-") && a->count == 0) {
-        UNARY_OP(x, -);
+    if (a->count == 1) {
+        /* only '-' takes a single operand, which it negates */
+        return negate(zlval_take(a, 0));
     }
 
-    while (a->count > 0) {
-        zlval* y = zlval_pop(a, 0);
-
-        zlval_maybe_promote_numeric(x, y);
-
-        if (streq(op, "+")) { BINARY_OP(x, y, +); }
-        if (streq(op, "-")) { BINARY_OP(x, y, -); }
-        if (streq(op, "*")) { BINARY_OP(x, y, *); }
-        if (streq(op, "/") || streq(op, "//") || streq(op, "%")) {
-            /* Handle division or modulo by zero */
-            if ((y->type == ZLVAL_INT && y->lng == 0) ||
-                (y->type == ZLVAL_FLOAT && y->dbl == 0)) {
-                zlval* err = zlval_err("division by zero; %i %s 0", x->lng, op);
-                zlval_del(x);
-                zlval_del(y);
-                x = err;
-                break;
-            }
-
-            if (strstr(op, "/")) {
-                zlval_type_t oldtype_x = x->type;
-                zlval_type_t oldtype_y = y->type;
-
-                /* Handle fractional integer division */
-                if (x->type == ZLVAL_INT && y->type == ZLVAL_INT && x->lng % y->lng != 0) {
-                    zlval_promote_numeric(x);
-                    zlval_promote_numeric(y);
-                }
-
-                BINARY_OP(x, y, /);
-
-                if (streq(op, "//")) {
-                    /* Truncating division, based on old types */
-                    if (oldtype_x == ZLVAL_INT && oldtype_y == ZLVAL_INT) {
-                        zlval_demote_numeric(x);
-                    } else {
-                        /* Truncate, but we still need to keep result a float */
-                        zlval_demote_numeric(x);
-                        zlval_promote_numeric(x);
-                    }
-                }
-            } else {
-                /* Handle modulo */
-                if (x->type == ZLVAL_FLOAT || y->type == ZLVAL_FLOAT) {
-                    BINARY_OP_FUNC(x, y, fmodulo);
-                } else {
-                    x->lng = modulo(x->lng, y->lng);
-                }
-            }
-        }
-        if (streq(op, "^")) {
-            if (x->type == ZLVAL_FLOAT || y->type == ZLVAL_FLOAT) {
-                BINARY_OP_FUNC(x, y, pow);
-            } else {
-                /* Handle case where result is fractional */
-                double ans = pow((double)x->lng, y->lng);
-                if (ans - (double)(long)ans != 0.0) {
-                    x->type = ZLVAL_FLOAT;
-                    x->dbl = ans;
-                } else {
-                    x->lng = (long)ans;
-                }
-            }
-
-            // Check for NaN
-            if (x->type == ZLVAL_FLOAT && isnan(x->dbl)) {
-                zlval_del(x);
-                x = zlval_err("pow resulted in NaN");
-            }
+    /* Fold leading integers without touching the heap, until an operand
+     * is a float or the integer kernel gives up */
+    zlval* x;
+    int i = 1;
+    if (a->cell[0]->type == ZLVAL_INT) {
+        long acc = a->cell[0]->lng;
+        long r;
+        while (i < a->count && a->cell[i]->type == ZLVAL_INT &&
+                op->fixnum(acc, a->cell[i]->lng, &r)) {
+            acc = r;
+            i++;
         }
+        x = zlval_int(acc);
+    } else {
+        x = zlval_unshare(zlval_copy(a->cell[0]));
+    }
 
+    for (; i < a->count && x->type != ZLVAL_ERR; i++) {
+        zlval* y = zlval_unshare(zlval_copy(a->cell[i]));
+        zlval_maybe_promote_numeric(x, y);
+        x = op->generic(x, y);
         zlval_del(y);
     }
 
@@ -167,37 +373,37 @@ zlval* builtin_num_op(zlenv* e, zlval* a, char* op) {
 
 zlval* builtin_add(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "+");
-    return builtin_num_op(e, a, "+");
+    return builtin_num_op(e, a, &num_add);
 }
 
 zlval* builtin_sub(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 1, "-");
-    return builtin_num_op(e, a, "-");
+    return builtin_num_op(e, a, &num_sub);
 }
 
 zlval* builtin_mul(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "*");
-    return builtin_num_op(e, a, "*");
+    return builtin_num_op(e, a, &num_mul);
 }
 
 zlval* builtin_div(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "/");
-    return builtin_num_op(e, a, "/");
+    return builtin_num_op(e, a, &num_div);
 }
 
 zlval* builtin_trunc_div(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "//");
-    return builtin_num_op(e, a, "//");
+    return builtin_num_op(e, a, &num_trunc_div);
 }
 
 zlval* builtin_mod(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "%");
-    return builtin_num_op(e, a, "%");
+    return builtin_num_op(e, a, &num_mod);
 }
 
 zlval* builtin_pow(zlenv* e, zlval* a) {
     ZLASSERT_MINARGCOUNT(a, 2, "^");
-    return builtin_num_op(e, a, "^");
+    return builtin_num_op(e, a, &num_pow);
 }
 
 zlval* builtin_ord_op(zlenv* e, zlval* a, char* op) {
@@ -206,10 +412,18 @@ zlval* builtin_ord_op(zlenv* e, zlval* a, char* op) {
     ZLASSERT_ISNUMERIC(a, 0, op);
     ZLASSERT_ISNUMERIC(a, 1, op);
 
-    zlval* x = zlval_pop(a, 0);
-    zlval* y = zlval_pop(a, 0);
+    zlval* x = zlval_unshare(zlval_pop(a, 0));
+    zlval* y = zlval_unshare(zlval_pop(a, 0));
 
     zlval_maybe_promote_numeric(x, y);
+    if (x->type == ZLVAL_BIGINT || y->type == ZLVAL_BIGINT) {
+        /* order integers by the sign of x - y */
+        long c = integer_cmp(x, y);
+        zlval_del(x);
+        zlval_del(y);
+        x = zlval_int(c);
+        y = zlval_int(0);
+    }
 
     bool res;
     if (streq(op, ">")) {
@@ -279,7 +493,7 @@ zlval* builtin_bool_op(zlenv* e, zlval* a, char* op) {
         EVAL_SINGLE_ARG(e, a, 0);
         ZLASSERT_TYPE(a, 0, ZLVAL_BOOL, op);
 
-        zlval* x = zlval_take(a, 0);
+        zlval* x = zlval_unshare(zlval_take(a, 0));
         x->bln = !x->bln;
         return x;
     }
@@ -314,6 +528,7 @@ zlval* builtin_bool_op(zlenv* e, zlval* a, char* op) {
         return err;
     }
 
+    x = zlval_unshare(x);
     if (streq(op, "and")) {
         x->bln = x->bln && y->bln;
     }
@@ -357,8 +572,10 @@ zlval* builtin_qhead(zlenv* e, zlval* a) {
     zlval* v = zlval_take(q, 0);
 
     if (v->type == ZLVAL_SEXPR) {
+        v = zlval_unshare(v);
         v->type = ZLVAL_QEXPR;
     } else if (v->type == ZLVAL_SYM) {
+        v = zlval_unshare(v);
         v->type = ZLVAL_QSYM;
     }
     return zlval_eval(e, v);
@@ -416,7 +633,7 @@ zlval* builtin_eval(zlenv* e, zlval* a) {
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_QEXPR, "eval");
 
-    zlval* x = zlval_take(a, 0);
+    zlval* x = zlval_unshare(zlval_take(a, 0));
     x->type = ZLVAL_SEXPR;
     return zlval_eval(e, x);
 }
@@ -445,7 +662,7 @@ zlval* builtin_cons(zlenv* e, zlval* a) {
 
     zlval* v = zlval_pop(a, 0);
     zlval* x = zlval_take(a, 0);
-    zlval_add_front(x, v);
+    x = zlval_add_front(x, v);
     return x;
 }
 
@@ -453,12 +670,17 @@ zlval* builtin_dictget(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 2, "dict-get");
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_DICT, "dict-get");
-    ZLASSERT_TYPE(a, 1, ZLVAL_QSYM, "dict-get");
+    ZLASSERT_ISHASHABLE(a, 1, "dict-get");
 
     zlval* d = zlval_pop(a, 0);
     zlval* k = zlval_take(a, 0);
 
     zlval* v = zlval_get_dict(d, k);
+    if (!v) {
+        char* repr = zlval_to_str(k);
+        v = zlval_err("no such key: %s", repr);
+        free(repr);
+    }
     zlval_del(d);
     zlval_del(k);
     return v;
@@ -468,7 +690,7 @@ zlval* builtin_dictset(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 3, "dict-set");
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_DICT, "dict-set");
-    ZLASSERT_TYPE(a, 1, ZLVAL_QSYM, "dict-set");
+    ZLASSERT_ISHASHABLE(a, 1, "dict-set");
 
     zlval* d = zlval_pop(a, 0);
     zlval* k = zlval_pop(a, 0);
@@ -484,12 +706,12 @@ zlval* builtin_dictdel(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 2, "dict-del");
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_DICT, "dict-del");
-    ZLASSERT_TYPE(a, 1, ZLVAL_QSYM, "dict-del");
+    ZLASSERT_ISHASHABLE(a, 1, "dict-del");
 
     zlval* d = zlval_pop(a, 0);
     zlval* k = zlval_take(a, 0);
 
-    zlval_rm_dict(d, k);
+    d = zlval_rm_dict(d, k);
     zlval_del(k);
     return d;
 }
@@ -498,7 +720,7 @@ zlval* builtin_dicthaskey(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 2, "dict-haskey?");
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_DICT, "dict-haskey?");
-    ZLASSERT_TYPE(a, 1, ZLVAL_QSYM, "dict-haskey?");
+    ZLASSERT_ISHASHABLE(a, 1, "dict-haskey?");
 
     zlval* d = zlval_pop(a, 0);
     zlval* k = zlval_take(a, 0);
@@ -703,7 +925,7 @@ zlval* builtin_let(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 2, "let");
     ZLASSERT_TYPE(a, 0, ZLVAL_SEXPR, "let");
 
-    zlval* bindings = a->cell[0];
+    zlval* bindings = a->cell[0] = zlval_unshare(a->cell[0]);
     /* verify structure of inner bindings list */
     for (int i = 0; i < bindings->count; i++) {
         ZLASSERT(a, (bindings->cell[i]->type == ZLVAL_SEXPR),
@@ -721,9 +943,15 @@ zlval* builtin_let(zlenv* e, zlval* a) {
                 "cannot redefine '%s'", bindings->cell[i]->cell[0]->sym);
     }
 
-    // TODO: Because of reference cycles, this causes garbage to build up
-    // Need to add GC
-    zlenv* lenv = zlenv_new();
+    /* closures bound here hold lenv through their parent, so the cycle
+     * collector reclaims it once nothing else does */
+    zlscope* scope = zlscope_new();
+    for (int i = 0; i < bindings->count; i++) {
+        zlscope_add(scope, bindings->cell[i]->cell[0]->atom);
+    }
+    zlenv* lenv = zlenv_new_frame(scope);
+    zlscope_release(scope);
+
     lenv->parent = e;
     lenv->parent->references++;
 
@@ -811,6 +1039,7 @@ zlval* builtin_convert(zlenv* e, zlval* a) {
     zlval* v = zlval_take(a, 0);
 
     zlval* res;
+    errno = 0;
     zlval_type_t type = zlval_parse_sysname(tsym->sym);
     if (errno != EINVAL) {
         res = zlval_convert(type, v);
@@ -824,76 +1053,83 @@ zlval* builtin_convert(zlenv* e, zlval* a) {
     return res;
 }
 
-zlval* builtin_import(zlenv* e, zlval* a) {
+static bool run_file(zlenv* e, const char* path, bool cache, char** err) {
+    /* each form is evaluated as soon as it is read, so a syntax error only
+     * stops the file once the forms before it have run */
+    zlreader* r = zlreader_open(path, cache, err);
+    if (!r) {
+        return false;
+    }
+    zlval* v;
+    int status;
+    while ((status = zlreader_next(r, &v, err)) > 0) {
+        zlval* x = zlval_eval(e, v);
+        if (x->type == ZLVAL_ERR) {
+            zlval_println(x);
+        }
+        zlval_del(x);
+    }
+    zlreader_close(r);
+    return status == 0;
+}
+
+static zlval* import_file(zlenv* e, zlval* a, bool module) {
+    /* modules are cached as images and imported once until they change,
+     * while scripts are run from source every time they are named; both
+     * are recorded, so importing a script later doesn't run it again */
     ZLASSERT_ARGCOUNT(a, 1, "import");
     EVAL_ARGS(e, a);
     ZLASSERT_TYPE(a, 0, ZLVAL_STR, "import");
 
-    // Check the import path
-    char* importPath = safe_malloc(strlen(a->cell[0]->str) + 5); // extra space for extension
-    strcpy(importPath, a->cell[0]->str);
-    strcat(importPath, ".spow");
-
-    // Attempt twice: once with the .spow extension, and once with the raw path
-    for (int attempt = 0; attempt < 2; attempt++) {
-        struct stat s;
-        errno = 0;
-        int statErr = stat(importPath, &s);
-
-        bool hasError = statErr || !S_ISREG(s.st_mode);
+    zlval* errval;
+    char* path = zlmodule_resolve(a->cell[0]->str, &errval);
+    if (!path) {
+        zlval_del(a);
+        return errval;
+    }
 
-        // Keep going if we've successfully found a file
-        if (!hasError) {
-            break;
-        } else {
-            free(importPath);
-
-            // Try the raw path if we have once more attempt
-            if (attempt == 0) {
-                importPath = safe_malloc(strlen(a->cell[0]->str) + 1);
-                strcpy(importPath, a->cell[0]->str);
-            } else {
-                // Return error otherwise
-                zlval* errval;
-                if (statErr && errno == ENOENT) {
-                    errval = zlval_err("path '%s' does not exist", a->cell[0]->str);
-                } else if (!S_ISREG(s.st_mode)) {
-                    errval = zlval_err("path '%s' is not a regular file", a->cell[0]->str);
-                } else {
-                    errval = zlval_err("unknown import error");
-                }
-                zlval_del(a);
-                return errval;
-            }
-        }
+    /* nothing to do if the module has run since it last changed */
+    if (!zlmodule_claim(path) && module) {
+        free(path);
+        zlval_del(a);
+        return zlval_qexpr();
     }
 
-    zlval* v;
     char* err;
-    if (zlval_parse_file(importPath, &v, &err)) {
-        free(importPath);
-
-        while (v->count) {
-            zlval* x = zlval_eval(e, zlval_pop(v, 0));
-            if (x->type == ZLVAL_ERR) {
-                zlval_println(x);
-            }
-            zlval_del(x);
-        }
-
-        zlval_del(v);
+    if (run_file(e, path, module, &err)) {
+        free(path);
         zlval_del(a);
-
         return zlval_qexpr();
-    } else {
-        free(importPath);
+    }
 
-        zlval* errval = zlval_err("could not import %s", err);
-        free(err);
-        zlval_del(a);
+    zlmodule_forget(path);
+    free(path);
+    errval = zlval_err("could not import %s", err);
+    free(err);
+    zlval_del(a);
 
-        return errval;
+    return errval;
+}
+
+zlval* builtin_import(zlenv* e, zlval* a) {
+    return import_file(e, a, true);
+}
+
+zlval* builtin_run_script(zlenv* e, zlval* a) {
+    /* "-" is the script on standard input, which is read as it comes in
+     * when it is a pipe */
+    if (a->count == 1 && a->cell[0]->type == ZLVAL_STR && streq(a->cell[0]->str, "-")) {
+        char* err;
+        zlval* x = zlval_qexpr();
+        if (!run_file(e, "/dev/stdin", false, &err)) {
+            zlval_del(x);
+            x = zlval_err("could not import %s", err);
+            free(err);
+        }
+        zlval_del(a);
+        return x;
     }
+    return import_file(e, a, false);
 }
 
 zlval* builtin_print(zlenv* e, zlval* a) {
@@ -924,6 +1160,76 @@ zlval* builtin_random(zlenv* e, zlval* a) {
     return zlval_float(r);
 }
 
+static zlval* add_stat(zlval* d, const char* name, zlval* v) {
+    zlval* k = zlval_qsym(name);
+    d = zlval_add_dict(d, k, v);
+    zlval_del(k);
+    zlval_del(v);
+    return d;
+}
+
+zlval* builtin_allocstats(zlenv* e, zlval* a) {
+    ZLASSERT_ARGCOUNT(a, 0, "alloc-stats");
+    zlval_del(a);
+
+    zlpool_stats s;
+    zlpool_get_stats(&s);
+
+    zlval* d = zlval_dict();
+    d = add_stat(d, "pooled", zlval_bool(SPOW_POOL));
+    d = add_stat(d, "live", zlval_int(s.live));
+    d = add_stat(d, "peak", zlval_int(s.peak));
+    d = add_stat(d, "allocs", zlval_int(s.allocs));
+    d = add_stat(d, "slabs", zlval_int(s.slabs));
+    d = add_stat(d, "capacity", zlval_int(s.capacity));
+    d = add_stat(d, "utilisation", zlval_float(s.capacity ? (double)s.live / s.capacity : 0.0));
+    return d;
+}
+
+static zlval* gc_stats(void) {
+    zlgc_stats s;
+    zlgc_get_stats(&s);
+
+    zlval* d = zlval_dict();
+    d = add_stat(d, "collections", zlval_int(s.collections));
+    d = add_stat(d, "reclaimed", zlval_int(s.reclaimed));
+    d = add_stat(d, "last-reclaimed", zlval_int(s.last_reclaimed));
+    d = add_stat(d, "last-traced", zlval_int(s.last_traced));
+    d = add_stat(d, "live", zlval_int(s.live));
+    d = add_stat(d, "threshold", zlval_int(s.threshold));
+    return d;
+}
+
+zlval* builtin_gc(zlenv* e, zlval* a) {
+    ZLASSERT_ARGCOUNT(a, 0, "gc");
+    zlval_del(a);
+
+    zlgc_collect();
+    return gc_stats();
+}
+
+zlval* builtin_gcthreshold(zlenv* e, zlval* a) {
+    ZLASSERT_ARGCOUNT(a, 1, "gc-threshold");
+    EVAL_ARGS(e, a);
+    ZLASSERT_TYPE(a, 0, ZLVAL_INT, "gc-threshold");
+    ZLASSERT(a, a->cell[0]->lng >= 0,
+            "function '%s' passed a negative threshold", "gc-threshold");
+
+    zlgc_set_threshold(a->cell[0]->lng);
+    zlval_del(a);
+    return gc_stats();
+}
+
+zlval* builtin_macroexpansions(zlenv* e, zlval* a) {
+    ZLASSERT_ARGCOUNT(a, 1, "macro-expansions");
+    EVAL_ARGS(e, a);
+    ZLASSERT_TYPE(a, 0, ZLVAL_MACRO, "macro-expansions");
+
+    zlval* x = zlval_int(a->cell[0]->proto->expansions);
+    zlval_del(a);
+    return x;
+}
+
 zlval* builtin_error(zlenv* e, zlval* a) {
     ZLASSERT_ARGCOUNT(a, 1, "error");
     EVAL_ARGS(e, a);
@@ -0,0 +1,297 @@
+#include "../include/compile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/util.h"
+
+#define CHUNK_INITIAL_SIZE 16
+#define CHUNK_GROWTH_FACTOR 2
+#define CHUNK_MAX_OPERAND 0xffff
+
+typedef struct {
+    zlchunk* c;
+    const zlenv* frame;
+    int depth;
+    bool failed;
+} compiler_t;
+
+zlchunk* zlchunk_new(void) {
+    zlchunk* c = safe_malloc(sizeof(zlchunk));
+    c->state = ZLCHUNK_PENDING;
+    c->references = 1;
+    c->code = NULL;
+    c->code_count = 0;
+    c->code_size = 0;
+    c->consts = NULL;
+    c->const_count = 0;
+    c->const_size = 0;
+    c->max_stack = 0;
+    return c;
+}
+
+zlchunk* zlchunk_retain(zlchunk* c) {
+    c->references++;
+    return c;
+}
+
+static void zlchunk_clear(zlchunk* c) {
+    for (int i = 0; i < c->const_count; i++) {
+        zlval_del(c->consts[i]);
+    }
+    free(c->consts);
+    free(c->code);
+
+    c->code = NULL;
+    c->code_count = c->code_size = 0;
+    c->consts = NULL;
+    c->const_count = c->const_size = 0;
+}
+
+void zlchunk_release(zlchunk* c) {
+    c->references--;
+    if (c->references <= 0) {
+        zlchunk_clear(c);
+        free(c);
+    }
+}
+
+static void emit_byte(compiler_t* cp, unsigned char b) {
+    zlchunk* c = cp->c;
+    if (c->code_count == c->code_size) {
+        c->code_size = c->code_size ? c->code_size * CHUNK_GROWTH_FACTOR : CHUNK_INITIAL_SIZE;
+        c->code = realloc(c->code, c->code_size);
+    }
+    c->code[c->code_count++] = b;
+}
+
+static void emit_short(compiler_t* cp, int x) {
+    if (x < 0 || x > CHUNK_MAX_OPERAND) {
+        cp->failed = true;
+        x = 0;
+    }
+    emit_byte(cp, x & 0xff);
+    emit_byte(cp, (x >> 8) & 0xff);
+}
+
+static void emit_op(compiler_t* cp, zlopcode_t op, int operand) {
+    emit_byte(cp, op);
+    emit_short(cp, operand);
+}
+
+/* emits a jump with a placeholder target, returning the operand position */
+static int emit_jump(compiler_t* cp, zlopcode_t op) {
+    emit_op(cp, op, 0);
+    return cp->c->code_count - 2;
+}
+
+static void patch_jump(compiler_t* cp, int pos) {
+    int target = cp->c->code_count;
+    if (target > CHUNK_MAX_OPERAND) {
+        cp->failed = true;
+        return;
+    }
+    cp->c->code[pos] = target & 0xff;
+    cp->c->code[pos + 1] = (target >> 8) & 0xff;
+}
+
+static int add_const(compiler_t* cp, const zlval* v) {
+    zlchunk* c = cp->c;
+    if (c->const_count == c->const_size) {
+        c->const_size = c->const_size ? c->const_size * CHUNK_GROWTH_FACTOR : CHUNK_INITIAL_SIZE;
+        c->consts = realloc(c->consts, sizeof(zlval*) * c->const_size);
+    }
+    c->consts[c->const_count] = zlval_copy(v);
+    return c->const_count++;
+}
+
+static void adjust_depth(compiler_t* cp, int delta) {
+    cp->depth += delta;
+    if (cp->depth > cp->c->max_stack) {
+        cp->c->max_stack = cp->depth;
+    }
+}
+
+static bool resolve_local(compiler_t* cp, const zlatom* sym, int* depth, int* slot) {
+    /* finds the frame and slot a local is bound in, counting frames up from
+     * the one the body runs in; globals are left to be looked up by name */
+    int d = 0;
+    for (const zlenv* e = cp->frame; e && !e->top_level; e = e->parent) {
+        int i = e->scope ? zlscope_index(e->scope, sym) : -1;
+        if (i != -1) {
+            *depth = d;
+            *slot = i;
+            return true;
+        }
+        d++;
+    }
+    return false;
+}
+
+static void compile_sym(compiler_t* cp, const zlval* v) {
+    int depth, slot;
+    int k = add_const(cp, v);
+    if (resolve_local(cp, v->atom, &depth, &slot)) {
+        emit_op(cp, ZLOP_LOAD_SLOT, k);
+        emit_short(cp, depth);
+        emit_short(cp, slot);
+    } else {
+        emit_op(cp, ZLOP_LOAD, k);
+    }
+    adjust_depth(cp, 1);
+}
+
+static bool has_escapes(const zlval* v) {
+    for (int i = 0; i < v->count; i++) {
+        zlval_type_t t = v->cell[i]->type;
+        if (t == ZLVAL_EEXPR || t == ZLVAL_CEXPR) {
+            return true;
+        }
+        if (ISEXPR(t) && has_escapes(v->cell[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool runs_code(const zlval* v) {
+    /* whether evaluating v may call something, and so have side effects */
+    return (v->type == ZLVAL_SEXPR && v->count > 0) || (v->type == ZLVAL_QEXPR && has_escapes(v));
+}
+
+static void compile_expr(compiler_t* cp, const zlval* v, bool tail);
+
+static void compile_call(compiler_t* cp, const zlval* v, bool tail) {
+    /* The callee decides at runtime whether its args are evaluated here
+     * or handed over unevaluated, so both paths are emitted:
+     *
+     *   <callee> PREPARE slow argc <args...> INVOKE argc JUMP end
+     *   slow: CALL form
+     *   end:
+     *
+     * A function's args are bound one at a time, and binding stops at the
+     * first error, so an arg followed by one that runs code is checked by
+     * ARG end n before going on */
+    int form = add_const(cp, v);
+    int argc = v->count - 1;
+
+    int last = 0;
+    for (int i = 1; i < v->count; i++) {
+        if (runs_code(v->cell[i])) {
+            last = i;
+        }
+    }
+    int* checks = last > 1 ? safe_malloc(sizeof(int) * (last - 1)) : NULL;
+
+    compile_expr(cp, v->cell[0], false);
+    int slow = emit_jump(cp, ZLOP_PREPARE);
+    emit_short(cp, argc);
+
+    for (int i = 1; i < v->count; i++) {
+        compile_expr(cp, v->cell[i], false);
+        if (i < last) {
+            checks[i - 1] = emit_jump(cp, ZLOP_ARG);
+            emit_short(cp, i);
+        }
+    }
+    emit_op(cp, tail ? ZLOP_TAIL_INVOKE : ZLOP_INVOKE, argc);
+    adjust_depth(cp, -argc);
+    int end = emit_jump(cp, ZLOP_JUMP);
+
+    patch_jump(cp, slow);
+    emit_op(cp, tail ? ZLOP_TAIL_CALL : ZLOP_CALL, form);
+    patch_jump(cp, end);
+    for (int i = 0; i < last - 1; i++) {
+        patch_jump(cp, checks[i]);
+    }
+    free(checks);
+}
+
+static void compile_if(compiler_t* cp, const zlval* v, bool tail) {
+    /* Inlined for as long as 'if' is bound to the builtin:
+     *
+     *   <callee> IF slow <pred> BRANCH else end <then> JUMP end
+     *   else: <else> JUMP end
+     *   slow: CALL form
+     *   end:
+     */
+    int form = add_const(cp, v);
+
+    compile_expr(cp, v->cell[0], false);
+    int slow = emit_jump(cp, ZLOP_IF);
+    adjust_depth(cp, -1);
+
+    compile_expr(cp, v->cell[1], false);
+    emit_byte(cp, ZLOP_BRANCH);
+    int branch_else = cp->c->code_count;
+    emit_short(cp, 0);
+    int branch_end = cp->c->code_count;
+    emit_short(cp, 0);
+    adjust_depth(cp, -1);
+
+    compile_expr(cp, v->cell[2], tail);
+    int then_end = emit_jump(cp, ZLOP_JUMP);
+
+    patch_jump(cp, branch_else);
+    adjust_depth(cp, -1);
+    compile_expr(cp, v->cell[3], tail);
+    int else_end = emit_jump(cp, ZLOP_JUMP);
+
+    patch_jump(cp, slow);
+    emit_op(cp, tail ? ZLOP_TAIL_CALL : ZLOP_CALL, form);
+
+    patch_jump(cp, branch_end);
+    patch_jump(cp, then_end);
+    patch_jump(cp, else_end);
+}
+
+static void compile_expr(compiler_t* cp, const zlval* v, bool tail) {
+    switch (v->type) {
+        case ZLVAL_SYM:
+            compile_sym(cp, v);
+            break;
+
+        case ZLVAL_SEXPR:
+            if (v->count == 0) {
+                emit_op(cp, ZLOP_EVAL, add_const(cp, v));
+                adjust_depth(cp, 1);
+            } else if (v->count == 4 && v->cell[0]->type == ZLVAL_SYM && streq(v->cell[0]->sym, "if")) {
+                compile_if(cp, v, tail);
+            } else {
+                compile_call(cp, v, tail);
+            }
+            break;
+
+        case ZLVAL_QEXPR:
+            emit_op(cp, has_escapes(v) ? ZLOP_EVAL : ZLOP_CONST, add_const(cp, v));
+            adjust_depth(cp, 1);
+            break;
+
+        case ZLVAL_EEXPR:
+        case ZLVAL_CEXPR:
+            emit_op(cp, ZLOP_EVAL, add_const(cp, v));
+            adjust_depth(cp, 1);
+            break;
+
+        default:
+            emit_op(cp, ZLOP_CONST, add_const(cp, v));
+            adjust_depth(cp, 1);
+            break;
+    }
+}
+
+bool zlchunk_compile(zlchunk* c, const zlval* body, const zlenv* frame) {
+    compiler_t cp = { c, frame, 0, false };
+
+    compile_expr(&cp, body, true);
+    emit_byte(&cp, ZLOP_RETURN);
+
+    if (cp.failed || cp.c->const_count > CHUNK_MAX_OPERAND) {
+        zlchunk_clear(c);
+        c->state = ZLCHUNK_FAILED;
+        return false;
+    }
+
+    c->state = ZLCHUNK_COMPILED;
+    return true;
+}
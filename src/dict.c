@@ -1,14 +1,140 @@
 #include "../include/dict.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "../include/pool.h"
 #include "../include/util.h"
 
-#define DICT_INITIAL_SIZE 16
-#define DICT_PROBE_INTERVAL 1
-#define DICT_LOAD_FACTOR 0.75
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Entries are appended to dense arrays in insertion order, and removing one
+ * only leaves a hole, so iterating over a dict visits its keys in the order
+ * they were first added. Holes are squeezed out when the arrays fill up.
+ *
+ * Dicts start out small: their first DICT_SMALL_SIZE entries live in the
+ * dict itself and are found with a linear scan over the key pointers,
+ * which is cheaper than hashing for the few names an environment or a dict
+ * literal usually holds. Past that, the entries move to the heap and get
+ * an index.
+ *
+ * The index is a Swiss table of entry positions: slots come in groups with
+ * a control byte each, which is either EMPTY, DELETED or the top 7 bits of
+ * the hash of the slot's key. A lookup compares a whole group of control
+ * bytes with the hash fragment at once, only looks at the entries whose
+ * fragment matches, and stops at the first group with an EMPTY slot. The
+ * positions are stored in as few bytes as the capacity allows */
+#define DICT_GROUP_WIDTH 16
+#define DICT_INITIAL_SIZE DICT_GROUP_WIDTH
 #define DICT_GROWTH_FACTOR 2
+/* entries take at most 7/8 of the index slots */
+#define DICT_MAX_LOAD(size) ((size) - (size) / 8)
+
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+
+static inline unsigned int slot_hash(const zlatom* k) {
+    /* atom hashes keep their entropy in the low bits, and the fragment
+     * stored in the control byte is taken from the top ones */
+    return k->hash * 0x9e3779b1u;
+}
+
+static inline unsigned char hash_fragment(unsigned int h) {
+    return h >> 25;
+}
+
+#if defined(__SSE2__)
+static inline unsigned int group_match(const unsigned char* g, unsigned char c) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+}
+
+static inline unsigned int group_match_free(const unsigned char* g) {
+    /* EMPTY and DELETED are the control bytes with the top bit set */
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+}
+#else
+static inline unsigned int group_match(const unsigned char* g, unsigned char c) {
+    unsigned int m = 0;
+    for (int i = 0; i < DICT_GROUP_WIDTH; i++) {
+        m |= (unsigned int)(g[i] == c) << i;
+    }
+    return m;
+}
+
+static inline unsigned int group_match_free(const unsigned char* g) {
+    unsigned int m = 0;
+    for (int i = 0; i < DICT_GROUP_WIDTH; i++) {
+        m |= (unsigned int)(g[i] >> 7) << i;
+    }
+    return m;
+}
+#endif
+
+static inline int first_match(unsigned int m) {
+    return __builtin_ctz(m);
+}
+
+static inline bool dict_is_small(const dict* d) {
+    return d->size == 0;
+}
+
+static size_t index_width(int size) {
+    /* positions stay below the capacity, which is below size */
+    if (size <= UINT8_MAX + 1) {
+        return sizeof(uint8_t);
+    } else if (size <= UINT16_MAX + 1) {
+        return sizeof(uint16_t);
+    }
+    return sizeof(uint32_t);
+}
+
+static inline int index_get(const dict* d, int i) {
+    if (d->size <= UINT8_MAX + 1) {
+        return ((const uint8_t*)d->index)[i];
+    } else if (d->size <= UINT16_MAX + 1) {
+        return ((const uint16_t*)d->index)[i];
+    }
+    return ((const uint32_t*)d->index)[i];
+}
+
+static inline void index_set(dict* d, int i, int e) {
+    if (d->size <= UINT8_MAX + 1) {
+        ((uint8_t*)d->index)[i] = e;
+    } else if (d->size <= UINT16_MAX + 1) {
+        ((uint16_t*)d->index)[i] = e;
+    } else {
+        ((uint32_t*)d->index)[i] = e;
+    }
+}
+
+static size_t dict_block_size(int size) {
+    return DICT_MAX_LOAD(size) * (sizeof(zlatom*) + sizeof(void*)) + size * (1 + index_width(size));
+}
+
+static void dict_alloc_table(dict* d, int size) {
+    /* one block: keys, values, control bytes, then the index */
+    d->size = size;
+    d->capacity = DICT_MAX_LOAD(size);
+    d->syms = safe_malloc(dict_block_size(size));
+    d->vals = (void**)(d->syms + d->capacity);
+    d->ctrl = (unsigned char*)(d->vals + d->capacity);
+    d->index = d->ctrl + size;
+    memset(d->ctrl, CTRL_EMPTY, size);
+}
+
+static void dict_init_small(dict* d) {
+    d->size = 0;
+    d->capacity = DICT_SMALL_SIZE;
+    d->syms = d->small_syms;
+    d->vals = d->small_vals;
+    d->ctrl = NULL;
+    d->index = NULL;
+}
 
 static void* maybe_copy(const dict* d, void* v) {
     if (d->copier) {
@@ -32,154 +158,215 @@ dict* dict_new(const copy_fn copier, const del_fn deleter) {
 }
 
 dict* dict_new_no_bindings(void) {
-    dict* d = safe_malloc(sizeof(dict));
-    d->size = DICT_INITIAL_SIZE;
+    dict* d = zlpool_alloc(sizeof(dict));
+    dict_init_small(d);
     d->count = 0;
-    d->syms = safe_malloc(sizeof(char*) * DICT_INITIAL_SIZE);
-    for (int i = 0; i < DICT_INITIAL_SIZE; i++) {
-        d->syms[i] = NULL;
-    }
-    d->vals = safe_malloc(sizeof(void*) * DICT_INITIAL_SIZE);
+    d->used = 0;
     d->copier = NULL;
     d->deleter = NULL;
     return d;
 }
 
 void dict_del(dict* d) {
-    for (int i = 0; i < d->size; i++) {
+    for (int i = 0; i < d->used; i++) {
         if (d->syms[i]) {
-            free(d->syms[i]);
             maybe_delete(d, d->vals[i]);
         }
     }
-    free(d->syms);
-    free(d->vals);
-    free(d);
-}
-
-static unsigned int dict_hash(const char* str) {
-    /* djb2 hash */
-    unsigned int hash = 5381;
-    for (int i = 0; str[i]; i++) {
-        /* XOR hash * 33 with current char val */
-        hash = ((hash << 5) + hash) ^ str[i];
+    if (!dict_is_small(d)) {
+        free(d->syms);
     }
-    return hash;
+    zlpool_free(d, sizeof(dict));
 }
 
-static int dict_findslot(const dict* d, const char* k) {
-    unsigned int i = dict_hash(k) % d->size;
-    unsigned int probe = 1;
-    while (d->syms[i] && !streq(d->syms[i], k)) {
-        i = (i + probe) % d->size;
-        probe += DICT_PROBE_INTERVAL;
+/* Groups are probed in triangular steps, which visits every group when
+ * their number is a power of two */
+static int dict_findslot(const dict* d, const zlatom* k) {
+    /* the index slot of k, or -1; keys are interned, so they compare by
+     * pointer */
+    unsigned int h = slot_hash(k);
+    unsigned int mask = d->size - 1;
+    unsigned int pos = h & mask & ~(DICT_GROUP_WIDTH - 1);
+    unsigned char c = hash_fragment(h);
+    for (unsigned int step = DICT_GROUP_WIDTH; ; step += DICT_GROUP_WIDTH) {
+        const unsigned char* g = d->ctrl + pos;
+        for (unsigned int m = group_match(g, c); m; m &= m - 1) {
+            int i = pos + first_match(m);
+            if (d->syms[index_get(d, i)] == k) {
+                return i;
+            }
+        }
+        if (group_match(g, CTRL_EMPTY)) {
+            return -1;
+        }
+        pos = (pos + step) & mask;
     }
-    return i;
 }
 
-static void* dict_lookup(const dict* d, const char* k) {
-    int i = dict_findslot(d, k);
-    if (d->syms[i]) {
-        return d->vals[i];
+static int dict_freeslot(const dict* d, unsigned int h) {
+    /* the first EMPTY or DELETED slot on the probe sequence of h */
+    unsigned int mask = d->size - 1;
+    unsigned int pos = h & mask & ~(DICT_GROUP_WIDTH - 1);
+    for (unsigned int step = DICT_GROUP_WIDTH; ; step += DICT_GROUP_WIDTH) {
+        unsigned int m = group_match_free(d->ctrl + pos);
+        if (m) {
+            return pos + first_match(m);
+        }
+        pos = (pos + step) & mask;
     }
-
-    return NULL;
 }
 
-/* forward declaration */
-static void dict_resize(dict* d);
-
-static void dict_set(dict* d, const char* k, void* v) {
-    int i = dict_findslot(d, k);
-    if (d->syms[i]) {
-        v = maybe_copy(d, v);
-        maybe_delete(d, d->vals[i]);
-        d->vals[i] = v;
-        return;
-    }
+static void dict_link(dict* d, int e) {
+    /* adds entry e to the index */
+    unsigned int h = slot_hash(d->syms[e]);
+    int i = dict_freeslot(d, h);
+    d->ctrl[i] = hash_fragment(h);
+    index_set(d, i, e);
+}
 
-    /* no existing entry found */
-    d->count++;
-    /* resize if needed */
-    if (d->count / (float)d->size >= DICT_LOAD_FACTOR) {
-        dict_resize(d);
-        i = dict_findslot(d, k);
+static void dict_compact(dict* d) {
+    /* squeezes the holes out of a small dict */
+    int n = 0;
+    for (int i = 0; i < d->used; i++) {
+        if (d->syms[i]) {
+            d->syms[n] = d->syms[i];
+            d->vals[n] = d->vals[i];
+            n++;
+        }
     }
-    d->syms[i] = safe_malloc(strlen(k) + 1);
-    strcpy(d->syms[i], k);
-    d->vals[i] = maybe_copy(d, v);
+    d->used = n;
 }
 
-static void dict_resize(dict* d) {
-    int oldsize = d->size;
-    d->size = d->size * DICT_GROWTH_FACTOR;
-
-    char** syms = d->syms;
+static void dict_resize(dict* d, int size) {
+    /* moves the entries into a table with size index slots, dropping the
+     * holes; each index slot ever taken had an entry appended for it, so
+     * the index never runs out of EMPTY slots before the entries fill up */
+    bool small = dict_is_small(d);
+    int used = d->used;
+    zlatom** syms = d->syms;
     void** vals = d->vals;
 
-    d->syms = safe_malloc(sizeof(char*) * d->size);
-    for (int i = 0; i < d->size; i++) {
-        d->syms[i] = NULL;
-    }
-    d->vals = safe_malloc(sizeof(void*) * d->size);
-
-    for (int i = 0; i < oldsize; i++) {
+    dict_alloc_table(d, size);
+    d->used = 0;
+    for (int i = 0; i < used; i++) {
         if (syms[i]) {
-            dict_set(d, syms[i], vals[i]);
+            d->syms[d->used] = syms[i];
+            d->vals[d->used] = vals[i];
+            dict_link(d, d->used++);
+        }
+    }
+    if (!small) {
+        free(syms);
+    }
+}
 
-            free(syms[i]);
-            maybe_delete(d, vals[i]);
+static void dict_reserve(dict* d) {
+    /* makes room to append an entry */
+    if (d->used < d->capacity) {
+        return;
+    }
+    if (dict_is_small(d)) {
+        if (d->count < DICT_SMALL_SIZE) {
+            dict_compact(d);
+        } else {
+            dict_resize(d, DICT_INITIAL_SIZE);
         }
+    } else {
+        /* grow if the entries take more than 3/4 of the room, otherwise
+         * only squeeze out the holes, which frees at least a quarter */
+        bool grow = d->count >= d->capacity - d->capacity / 4;
+        dict_resize(d, grow ? d->size * DICT_GROWTH_FACTOR : d->size);
     }
-    free(syms);
-    free(vals);
 }
 
-int dict_index(const dict* d, const char* k) {
-    int i = dict_findslot(d, k);
-    if (!d->syms[i]) {
-        i = -1;
+int dict_index(const dict* d, const zlatom* k) {
+    /* the position of k's entry, or -1 */
+    if (dict_is_small(d)) {
+        for (int i = 0; i < d->used; i++) {
+            if (d->syms[i] == k) {
+                return i;
+            }
+        }
+        return -1;
     }
-    return i;
+    int i = dict_findslot(d, k);
+    return i != -1 ? index_get(d, i) : -1;
 }
 
-void* dict_get(const dict* d, const char* k) {
-    return maybe_copy(d, dict_lookup(d, k));
+void* dict_get(const dict* d, const zlatom* k) {
+    /* NULL if k isn't there */
+    int i = dict_index(d, k);
+    return i != -1 ? maybe_copy(d, d->vals[i]) : NULL;
 }
 
 void* dict_get_at(const dict* d, int i) {
     return maybe_copy(d, d->vals[i]);
 }
 
-void dict_put(dict* d, const char* k, void* v) {
-    dict_set(d, k, v);
+void dict_put(dict* d, zlatom* k, void* v) {
+    /* a key already there keeps its place */
+    int i = dict_index(d, k);
+    if (i != -1) {
+        v = maybe_copy(d, v);
+        maybe_delete(d, d->vals[i]);
+        d->vals[i] = v;
+        return;
+    }
+
+    dict_reserve(d);
+    i = d->used++;
+    d->syms[i] = k;
+    d->vals[i] = maybe_copy(d, v);
+    d->count++;
+    if (!dict_is_small(d)) {
+        dict_link(d, i);
+    }
 }
 
-void dict_rm(dict* d, const char* k) {
-    int i = dict_findslot(d, k);
-    if (d->syms[i]) {
-        d->count--;
-        maybe_delete(d, d->vals[i]);
-        free(d->syms[i]);
-        d->syms[i] = NULL;
+void dict_rm(dict* d, const zlatom* k) {
+    int e;
+    if (dict_is_small(d)) {
+        e = dict_index(d, k);
+        if (e == -1) {
+            return;
+        }
+    } else {
+        int i = dict_findslot(d, k);
+        if (i == -1) {
+            return;
+        }
+        e = index_get(d, i);
+
+        /* A lookup only carries on past a group with no EMPTY slot, so
+         * when the group still has one no probe sequence runs through it,
+         * and the slot can be freed outright instead of leaving a
+         * tombstone */
+        const unsigned char* g = d->ctrl + (i & ~(DICT_GROUP_WIDTH - 1));
+        d->ctrl[i] = group_match(g, CTRL_EMPTY) ? CTRL_EMPTY : CTRL_DELETED;
     }
+
+    d->count--;
+    maybe_delete(d, d->vals[e]);
+    d->syms[e] = NULL;
 }
 
 dict* dict_copy(const dict* d) {
-    dict* n = safe_malloc(sizeof(dict));
-    n->size = d->size;
-    n->count = 0;
+    dict* n = zlpool_alloc(sizeof(dict));
+    n->count = d->count;
+    n->used = d->used;
     n->copier = d->copier;
     n->deleter = d->deleter;
-    n->syms = safe_malloc(sizeof(char*) * d->size);
-    for (int i = 0; i < d->size; i++) {
-        n->syms[i] = NULL;
-    }
-    n->vals = safe_malloc(sizeof(void*) * d->size);
 
-    for (int i = 0; i < d->size; i++) {
+    if (dict_is_small(d)) {
+        dict_init_small(n);
+    } else {
+        dict_alloc_table(n, d->size);
+        memcpy(n->ctrl, d->ctrl, d->size * (1 + index_width(d->size)));
+    }
+    for (int i = 0; i < d->used; i++) {
+        n->syms[i] = d->syms[i];
         if (d->syms[i]) {
-            dict_set(n, d->syms[i], d->vals[i]);
+            n->vals[i] = maybe_copy(d, d->vals[i]);
         }
     }
 
@@ -190,11 +377,12 @@ int dict_count(const dict* d) {
     return d->count;
 }
 
-char** dict_all_keys(const dict* d) {
-    char** keys = safe_malloc(sizeof(char*) * d->count);
+zlatom** dict_all_keys(const dict* d) {
+    /* in insertion order */
+    zlatom** keys = safe_malloc(sizeof(zlatom*) * d->count);
     int offset = 0;
 
-    for (int i = 0; i < d->size; i++) {
+    for (int i = 0; i < d->used; i++) {
         if (d->syms[i]) {
             keys[offset++] = d->syms[i];
         }
@@ -203,21 +391,14 @@ char** dict_all_keys(const dict* d) {
 }
 
 void** dict_all_vals(const dict* d) {
+    /* in the same order as dict_all_keys */
     void** vals = safe_malloc(sizeof(void*) * d->count);
     int offset = 0;
 
-    for (int i = 0; i < d->size; i++) {
+    for (int i = 0; i < d->used; i++) {
         if (d->syms[i]) {
             vals[offset++] = d->vals[i];
         }
     }
     return vals;
 }
-
-bool dict_equal(const dict* d1, const dict* d2) {
-    if (d1->count != d2->count) {
-        return false;
-    }
-    /* TODO: Check keys/values, but order doesn't matter! */
-    return true;
-}
@@ -4,7 +4,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "../include/builtins.h"
+#include "../include/compile.h"
+#include "../include/gc.h"
 #include "../include/util.h"
+#include "../include/vm.h"
 
 #define ZLENV_DEL_RECURSING(e) { \
     if (recursing) { \
@@ -18,54 +21,85 @@ void zlval_eval_abort(void) {
     eval_aborted = true;
 }
 
-zlval* zlval_eval(zlenv* e, zlval* v) {
+bool zlval_eval_check_abort(void) {
+    if (eval_aborted) {
+        eval_aborted = false;
+        return true;
+    }
+    return false;
+}
+
+static zlval* zlval_eval_loop(zlenv* e, zlval* v, zlval* x) {
+    /* v is a form to evaluate, x the result of a call that still has to be
+     * evaluated; exactly one of them is given */
     bool recursing = false;
 
     while (true) {
         // Handle abort
         if (eval_aborted) {
             ZLENV_DEL_RECURSING(e);
-            zlval_del(v);
+            zlval_del(x ? x : v);
 
             eval_aborted = false;
             return zlval_err("eval aborted");
         }
 
+        if (x) {
+            /* recursively evaluate results */
+            if (x->type == ZLVAL_FN && x->called) {
+                ZLENV_DEL_RECURSING(e);
+                recursing = true;
+
+                zlgc_poll();
+                e = zlval_enter(x);
+#if SPOW_VM
+                zlchunk* c = zlvm_load(x);
+                if (c) {
+                    /* let go of x first, so the frame is only held here */
+                    zlchunk_retain(c);
+                    zlval_del(x);
+
+                    bool pending;
+                    zlval* r = zlvm_exec(&e, c, &pending);
+                    zlchunk_release(c);
+
+                    if (!pending) {
+                        ZLENV_DEL_RECURSING(e);
+                        return r;
+                    }
+                    x = r;
+                    continue;
+                }
+#endif
+                v = zlval_copy(x->proto->body);
+
+                zlval_del(x);
+            } else {
+                /* evaluate result in next loop */
+                v = x;
+            }
+            x = NULL;
+        }
+
         switch (v->type) {
             case ZLVAL_SYM:
             {
-                zlval* x = zlenv_get(e, v);
+                zlval* r = zlenv_get(e, v);
                 zlval_del(v);
                 ZLENV_DEL_RECURSING(e);
-                return x;
+                return r;
                 break;
             }
 
             case ZLVAL_SEXPR:
-            {
-                zlval* x = zlval_eval_sexpr(e, v);
-
-                /* recursively evaluate results */
-                if (x->type == ZLVAL_FN && x->called) {
-                    ZLENV_DEL_RECURSING(e);
-                    recursing = true;
-
-                    e = zlenv_copy(x->env);
-                    v = zlval_copy(x->body);
-
-                    zlval_del(x);
-                } else {
-                    /* evaluate result in next loop */
-                    v = x;
-                }
+                x = zlval_eval_sexpr(e, v);
                 break;
-            }
 
             case ZLVAL_QEXPR:
             {
-                zlval* x = zlval_eval_inside_qexpr(e, v);
+                zlval* r = zlval_eval_inside_qexpr(e, v);
                 ZLENV_DEL_RECURSING(e);
-                return x;
+                return r;
                 break;
             }
 
@@ -87,8 +121,29 @@ zlval* zlval_eval(zlenv* e, zlval* v) {
     }
 }
 
+zlval* zlval_eval(zlenv* e, zlval* v) {
+    return zlval_eval_loop(e, v, NULL);
+}
+
+zlenv* zlval_enter(zlval* f) {
+    /* The frame a called function runs in. It is the one its args were
+     * bound in, unless some other copy of f can still see that */
+    if (f->references == 1) {
+        f->env->references++;
+        return f->env;
+    }
+    return zlenv_copy(f->env);
+}
+
+zlval* zlval_eval_result(zlenv* e, zlval* x) {
+    return zlval_eval_loop(e, NULL, x);
+}
+
 zlval* zlval_eval_arg(zlenv* e, zlval* v, int arg) {
-    v->cell[arg] = zlval_eval(e, v->cell[arg]);
+    v = zlval_unshare(v);
+    if (!v->evaluated) {
+        v->cell[arg] = zlval_eval(e, v->cell[arg]);
+    }
     if (v->cell[arg]->type == ZLVAL_ERR) {
         return zlval_take(v, arg);
     }
@@ -96,9 +151,14 @@ zlval* zlval_eval_arg(zlenv* e, zlval* v, int arg) {
 }
 
 zlval* zlval_eval_args(zlenv* e, zlval* v) {
-    for (int i = 0; i < v->count; i++) {
-        v->cell[i] = zlval_eval(e, v->cell[i]);
+    v = zlval_unshare(v);
+    /* args handed over by the VM have already been evaluated */
+    if (!v->evaluated) {
+        for (int i = 0; i < v->count; i++) {
+            v->cell[i] = zlval_eval(e, v->cell[i]);
+        }
     }
+    v->evaluated = false;
 
     for (int i = 0; i < v->count; i++) {
         if (v->cell[i]->type == ZLVAL_ERR) {
@@ -114,22 +174,62 @@ zlval* zlval_eval_sexpr(zlenv* e, zlval* v) {
         return zlval_err("cannot evaluate empty %s", zlval_type_name(ZLVAL_SEXPR));
     }
 
-    EVAL_SINGLE_ARG(e, v, 0);
-    zlval* f = zlval_pop(v, 0);
+    /* a form kept elsewhere, as in a function body, may be run again, so
+     * it is held on to as the site of the call */
+    zlval* site = v->references > 1 ? zlval_copy(v) : NULL;
 
-    if (!ISCALLABLE(f->type)) {
-        zlval* err = zlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
-                zlval_type_name(ZLVAL_SEXPR), zlval_type_name(f->type));
-        zlval_del(v);
+    v = zlval_unshare(v);
+    v = zlval_eval_arg(e, v, 0);
+    zlval* result;
+
+    if (v->type == ZLVAL_ERR) {
+        result = v;
+    } else {
+        zlval* f = zlval_pop(v, 0);
+
+        if (!ISCALLABLE(f->type)) {
+            result = zlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
+                    zlval_type_name(ZLVAL_SEXPR), zlval_type_name(f->type));
+            zlval_del(v);
+        } else {
+            result = zlval_call_site(e, f, v, site);
+        }
         zlval_del(f);
-        return err;
     }
 
-    zlval* result = zlval_call(e, f, v);
-    zlval_del(f);
+    if (site) {
+        zlval_del(site);
+    }
     return result;
 }
 
+zlval* zlval_kept_expansion(const zlval* site, const zlval* f) {
+    return site->expanded_by == f ? zlval_copy(site->expansion) : NULL;
+}
+
+zlval* zlval_call_site(zlenv* e, zlval* f, zlval* a, zlval* site) {
+    /* Macros are expanded once per call site: the expansion is kept on
+     * the form that made the call, and used again as long as it calls the
+     * same macro, so redefining the macro expands it anew */
+    if (!site || f->type != ZLVAL_MACRO) {
+        return zlval_call(e, f, a);
+    }
+
+    zlval* x = zlval_kept_expansion(site, f);
+    if (x) {
+        zlval_del(a);
+        return x;
+    }
+
+    /* partial applications return before anything is expanded */
+    int expansions = f->proto->expansions;
+    x = zlval_call(e, f, a);
+    if (f->proto->expansions != expansions && x->type != ZLVAL_ERR) {
+        zlval_set_expansion(site, f, x);
+    }
+    return x;
+}
+
 zlval* zlval_call(zlenv* e, zlval* f, zlval* a) {
     /* calls a function if builtin, or evals a macro, else fills in the
      * corresponding parameters, and lets zlval_eval perform tail
@@ -139,8 +239,14 @@ zlval* zlval_call(zlenv* e, zlval* f, zlval* a) {
         return f->builtin(e, a);
     }
 
+    /* parameters are bound in a copy of its own, as f may be shared; the
+     * copy shares the formals and body of its prototype */
+    f = zlval_unshare(zlval_copy(f));
+    zlproto* p = f->proto;
+    zlval* formals = p->formals;
+
     int given = a->count;
-    int total = f->formals->count;
+    int total = formals->count - f->bound;
 
     /* special case for macros */
     if (f->type == ZLVAL_MACRO) {
@@ -159,63 +265,62 @@ zlval* zlval_call(zlenv* e, zlval* f, zlval* a) {
     }
 
     while (a->count) {
-        if (f->formals->count == 0) {
-            zlval_del(a);
-            return zlval_err("%s passed too many arguments; got %i, expected %i",
+        if (f->bound == formals->count) {
+            zlval* err = zlval_err("%s passed too many arguments; got %i, expected %i",
                     zlval_type_name(f->type), given, total);
+            zlval_del(f);
+            zlval_del(a);
+            return err;
         }
-        zlval* sym = zlval_pop(f->formals, 0);
 
         /* special case for variadic functions */
-        if (streq(sym->sym, "&")) {
-            if (f->formals->count != 1) {
+        if (f->bound == p->arity) {
+            if (formals->count - f->bound != 2) {
+                zlval_del(f);
                 zlval_del(a);
                 return zlval_err("function format invalid; symbol '&' not followed by single symbol");
             }
 
-            zlval* nsym = zlval_pop(f->formals, 0);
-            zlval* varargs = builtin_list(e, a);
-
-            if (varargs->type == ZLVAL_ERR) {
-                zlval_del(sym);
-                zlval_del(nsym);
-                return varargs;
+            a = builtin_list(e, a);
+            if (a->type == ZLVAL_ERR) {
+                zlval_del(f);
+                return a;
             }
 
-            zlenv_put(f->env, nsym, varargs);
-            zlval_del(sym);
-            zlval_del(nsym);
+            zlenv_put(f->env, formals->cell[f->bound + 1], a);
+            f->bound = formals->count;
             break;
         }
 
-        zlval* val = zlval_eval(e, zlval_pop(a, 0));
+        zlval* val = zlval_pop(a, 0);
+        if (!a->evaluated) {
+            val = zlval_eval(e, val);
+        }
         if (val->type == ZLVAL_ERR) {
-            zlval_del(sym);
+            zlval_del(f);
             zlval_del(a);
             return val;
         }
 
-        zlenv_put(f->env, sym, val);
-        zlval_del(sym);
+        zlenv_put(f->env, formals->cell[f->bound], val);
         zlval_del(val);
+        f->bound++;
     }
 
     /* Special case for pure variadic function with no arguments */
-    if (f->formals->count > 0 &&
-            streq(f->formals->cell[0]->sym, "&")) {
-        if (f->formals->count != 2) {
+    if (f->bound == p->arity && p->variadic) {
+        if (formals->count - f->bound != 2) {
+            zlval_del(f);
+            zlval_del(a);
             return zlval_err("function format invalid; symbol '&' not followed by single symbol");
         }
-        zlval_del(zlval_pop(f->formals, 0));
-        zlval* sym = zlval_pop(f->formals, 0);
         zlval* val = zlval_qexpr();
-
-        zlenv_put(f->env, sym, val);
-        zlval_del(sym);
+        zlenv_put(f->env, formals->cell[f->bound + 1], val);
         zlval_del(val);
+        f->bound = formals->count;
     }
 
-    if (f->formals->count == 0) {
+    if (f->bound == formals->count) {
         f->called = true;
     }
 
@@ -224,54 +329,90 @@ zlval* zlval_call(zlenv* e, zlval* f, zlval* a) {
     /* Handle macros -- they are called directly because their output must
      * be evaluated in the enclosing environment */
     if (f->type == ZLVAL_MACRO && f->called) {
-        return zlval_eval_macro(f);
+        zlval* x = zlval_eval_macro(f);
+        zlval_del(f);
+        return x;
     } else {
-        return zlval_copy(f);
+        return f;
     }
 }
 
 zlval* zlval_eval_macro(zlval* m) {
-    zlenv* e = zlenv_copy(m->env);
-    zlval* b = zlval_copy(m->body);
+    m->proto->expansions++;
+    zlenv* e = zlval_enter(m);
+    zlval* b = zlval_copy(m->proto->body);
 
     zlval* v = zlval_eval(e, b);
 
     zlenv_del(e);
 
     if (v->type == ZLVAL_QEXPR) {
+        v = zlval_unshare(v);
         v->type = ZLVAL_SEXPR;
     }
     return v;
 }
 
+static zlval* zlval_eval_template_cell(zlenv* e, zlval* c) {
+    if (c->type == ZLVAL_CEXPR) {
+        return zlval_eval_cexpr(e, zlval_copy(c));
+    }
+    return zlval_eval_inside_qexpr(e, zlval_copy(c));
+}
+
 zlval* zlval_eval_inside_qexpr(zlenv* e, zlval* v) {
     switch (v->type) {
         case ZLVAL_SEXPR:
         case ZLVAL_QEXPR:
         {
-            for (int i = 0; i < v->count; i++) {
-                // Special case for C-Expressions
-                if (v->cell[i]->type == ZLVAL_CEXPR) {
-                    zlval* cexpr = zlval_eval_cexpr(e, zlval_pop(v, i));
-                    if (cexpr->type == ZLVAL_ERR) {
-                        zlval_del(v);
-                        return cexpr;
-                    }
+            if (v->plain) {
+                return v;
+            }
+            /* v is only rebuilt once something inside it changes */
+            int i = 0;
+            zlval* x = NULL;
+            for (; i < v->count; i++) {
+                x = zlval_eval_template_cell(e, v->cell[i]);
+                if (x != v->cell[i]) {
+                    break;
+                }
+                zlval_del(x);
+            }
+            if (i == v->count) {
+                /* nothing to evaluate inside, which holds for its copies too */
+                v->plain = true;
+                return v;
+            }
 
-                    // Populate current container with result of CExpr
-                    if (cexpr->type == ZLVAL_QEXPR) {
-                        v = zlval_shift(v, cexpr, i);
-                    } else {
-                        v = zlval_insert(v, cexpr, i);
+            /* the rest is built in one pass, with room for the cells of v
+             * and of each list spliced in made before adding them */
+            zlval* r = v->type == ZLVAL_SEXPR ? zlval_sexpr() : zlval_qexpr();
+            r = zlval_reserve(r, v->count);
+            for (int j = 0; j < i; j++) {
+                r = zlval_add(r, zlval_copy(v->cell[j]));
+            }
+            for (;;) {
+                if (x->type == ZLVAL_ERR) {
+                    zlval_del(r);
+                    zlval_del(v);
+                    return x;
+                }
+                if (v->cell[i]->type == ZLVAL_CEXPR && x->type == ZLVAL_QEXPR) {
+                    r = zlval_reserve(r, x->count + v->count - i - 1);
+                    for (int j = 0; j < x->count; j++) {
+                        r = zlval_add(r, zlval_copy(x->cell[j]));
                     }
+                    zlval_del(x);
                 } else {
-                    v->cell[i] = zlval_eval_inside_qexpr(e, v->cell[i]);
-                    if (v->cell[i]->type == ZLVAL_ERR) {
-                        return zlval_take(v, i);
-                    }
+                    r = zlval_add(r, x);
+                }
+                if (++i == v->count) {
+                    break;
                 }
+                x = zlval_eval_template_cell(e, v->cell[i]);
             }
-            return v;
+            zlval_del(v);
+            return r;
             break;
         }
 
@@ -0,0 +1,314 @@
+#include "../include/gc.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "../include/hamt.h"
+
+#define GC_LIST_INITIAL_SIZE 256
+#define GC_GROWTH_FACTOR 2
+
+/* Reference counting frees everything but cycles, and every cycle passes
+ * through an environment: a closure holds its frame, whose bindings or
+ * parents hold the closure. The collector works out which environments
+ * are only kept alive by such cycles by trial deletion:
+ *
+ *   1. trace everything reachable from the live environments
+ *   2. take every reference held inside the traced graph off the counts;
+ *      whatever still has references left is held from outside it (C
+ *      locals, the VM stack, function code) and is a root
+ *   3. mark everything reachable from the roots
+ *   4. clear the environments left unmarked, which breaks their cycles and
+ *      lets reference counting free the rest
+ */
+
+typedef enum {
+    GC_ENV,
+    GC_VAL,
+    GC_VEC,
+    GC_HAMT
+} gcnode_kind_t;
+
+typedef struct {
+    gcnode_kind_t kind;
+    void* p;
+} gcnode;
+
+typedef struct {
+    gcnode* nodes;
+    int count;
+    int size;
+} gclist;
+
+typedef void(*gcvisitor)(gclist*, gcnode);
+
+static zlenv* tracked = NULL;
+static zlgc_stats stats = { 0, 0, 0, 0, 0, SPOW_GC_THRESHOLD };
+static long next_collection = SPOW_GC_THRESHOLD;
+static bool collecting = false;
+
+void zlgc_track(zlenv* e) {
+    e->gc_state = ZLGC_UNSEEN;
+    e->gc_prev = NULL;
+    e->gc_next = tracked;
+    if (tracked) {
+        tracked->gc_prev = e;
+    }
+    tracked = e;
+    stats.live++;
+}
+
+void zlgc_untrack(zlenv* e) {
+    if (e->gc_prev) {
+        e->gc_prev->gc_next = e->gc_next;
+    } else {
+        tracked = e->gc_next;
+    }
+    if (e->gc_next) {
+        e->gc_next->gc_prev = e->gc_prev;
+    }
+    stats.live--;
+}
+
+static void push(gclist* l, gcnode n) {
+    if (l->count == l->size) {
+        l->size = l->size ? l->size * GC_GROWTH_FACTOR : GC_LIST_INITIAL_SIZE;
+        l->nodes = realloc(l->nodes, sizeof(gcnode) * l->size);
+    }
+    l->nodes[l->count++] = n;
+}
+
+static int* node_gc_refs(gcnode n) {
+    switch (n.kind) {
+        case GC_ENV:
+            return &((zlenv*)n.p)->gc_refs;
+        case GC_VAL:
+            return &((zlval*)n.p)->gc_refs;
+        case GC_HAMT:
+            return &((zlhamt*)n.p)->gc_refs;
+        default:
+            return &((zlvec*)n.p)->gc_refs;
+    }
+}
+
+static unsigned char* node_gc_state(gcnode n) {
+    switch (n.kind) {
+        case GC_ENV:
+            return &((zlenv*)n.p)->gc_state;
+        case GC_VAL:
+            return &((zlval*)n.p)->gc_state;
+        case GC_HAMT:
+            return &((zlhamt*)n.p)->gc_state;
+        default:
+            return &((zlvec*)n.p)->gc_state;
+    }
+}
+
+static int node_references(gcnode n) {
+    switch (n.kind) {
+        case GC_ENV:
+            return ((zlenv*)n.p)->references;
+        case GC_VAL:
+            return ((zlval*)n.p)->references;
+        case GC_HAMT:
+            return ((zlhamt*)n.p)->references;
+        default:
+            return ((zlvec*)n.p)->references;
+    }
+}
+
+static void visit_dict(gclist* l, const dict* d, gcvisitor f) {
+    for (int i = 0; i < d->used; i++) {
+        if (d->syms[i]) {
+            f(l, (gcnode){ GC_VAL, d->vals[i] });
+        }
+    }
+}
+
+static void visit_children(gclist* l, gcnode n, gcvisitor f) {
+    /* every reference followed here is counted in its target */
+    switch (n.kind) {
+        case GC_ENV:
+        {
+            zlenv* e = n.p;
+            if (e->parent) {
+                f(l, (gcnode){ GC_ENV, e->parent });
+            }
+            for (int i = 0; e->scope && i < e->scope->count; i++) {
+                if (e->slots[i]) {
+                    f(l, (gcnode){ GC_VAL, e->slots[i] });
+                }
+            }
+            if (e->internal_dict) {
+                visit_dict(l, e->internal_dict, f);
+            }
+            break;
+        }
+
+        case GC_VAL:
+        {
+            zlval* v = n.p;
+            switch (v->type) {
+                case ZLVAL_FN:
+                case ZLVAL_MACRO:
+                    /* the shared code is left untraced, as a root */
+                    f(l, (gcnode){ GC_ENV, v->env });
+                    break;
+
+                case ZLVAL_DICT:
+                    if (v->map) {
+                        f(l, (gcnode){ GC_HAMT, v->map });
+                    }
+                    if (v->order) {
+                        f(l, (gcnode){ GC_HAMT, v->order });
+                    }
+                    break;
+
+                case ZLVAL_SEXPR:
+                case ZLVAL_QEXPR:
+                case ZLVAL_EEXPR:
+                case ZLVAL_CEXPR:
+                    if (v->vec) {
+                        f(l, (gcnode){ GC_VEC, v->vec });
+                    }
+                    if (v->expansion) {
+                        f(l, (gcnode){ GC_VAL, v->expansion });
+                        f(l, (gcnode){ GC_VAL, v->expanded_by });
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+            break;
+        }
+
+        case GC_VEC:
+        {
+            zlvec* s = n.p;
+            for (int i = s->front; i < s->back; i++) {
+                f(l, (gcnode){ GC_VAL, s->slots[i] });
+            }
+            break;
+        }
+
+        case GC_HAMT:
+        {
+            zlhamt* t = n.p;
+            for (int i = 0; i < zlhamt_node_entries(t); i++) {
+                f(l, (gcnode){ GC_VAL, t->entries[i].val });
+            }
+            zlhamt** child = zlhamt_node_child(t);
+            for (int i = 0; i < zlhamt_node_children(t); i++) {
+                f(l, (gcnode){ GC_HAMT, child[i] });
+            }
+            break;
+        }
+    }
+}
+
+static void trace(gclist* l, gcnode n) {
+    unsigned char* state = node_gc_state(n);
+    if (*state == ZLGC_UNSEEN) {
+        *state = ZLGC_SEEN;
+        *node_gc_refs(n) = node_references(n);
+        push(l, n);
+    }
+}
+
+static void subtract(gclist* l, gcnode n) {
+    (*node_gc_refs(n))--;
+}
+
+static void reach(gclist* l, gcnode n) {
+    unsigned char* state = node_gc_state(n);
+    if (*state != ZLGC_REACHABLE) {
+        *state = ZLGC_REACHABLE;
+        push(l, n);
+    }
+}
+
+int zlgc_collect(void) {
+    if (collecting) {
+        return 0;
+    }
+    collecting = true;
+
+    gclist traced = { NULL, 0, 0 };
+    gclist pending = { NULL, 0, 0 };
+    gclist garbage = { NULL, 0, 0 };
+
+    for (zlenv* e = tracked; e; e = e->gc_next) {
+        trace(&traced, (gcnode){ GC_ENV, e });
+    }
+    for (int i = 0; i < traced.count; i++) {
+        visit_children(&traced, traced.nodes[i], trace);
+    }
+
+    for (int i = 0; i < traced.count; i++) {
+        visit_children(NULL, traced.nodes[i], subtract);
+    }
+
+    for (int i = 0; i < traced.count; i++) {
+        gcnode n = traced.nodes[i];
+        if (*node_gc_refs(n) > 0 || (n.kind == GC_ENV && ((zlenv*)n.p)->top_level)) {
+            reach(&pending, n);
+        }
+    }
+    while (pending.count) {
+        visit_children(&pending, pending.nodes[--pending.count], reach);
+    }
+
+    /* hold on to the garbage while clearing it, and forget the scratch
+     * state first, as clearing frees the values that were traced */
+    for (int i = 0; i < traced.count; i++) {
+        gcnode n = traced.nodes[i];
+        if (n.kind == GC_ENV && *node_gc_state(n) != ZLGC_REACHABLE) {
+            ((zlenv*)n.p)->references++;
+            push(&garbage, n);
+        }
+        *node_gc_state(n) = ZLGC_UNSEEN;
+    }
+    for (int i = 0; i < garbage.count; i++) {
+        zlenv_clear(garbage.nodes[i].p);
+    }
+    for (int i = 0; i < garbage.count; i++) {
+        zlenv_del(garbage.nodes[i].p);
+    }
+
+    stats.collections++;
+    stats.reclaimed += garbage.count;
+    stats.last_reclaimed = garbage.count;
+    stats.last_traced = traced.count;
+
+    /* leave room to grow in proportion to what survived, so collections
+     * stay rare when most environments are in use */
+    if (stats.threshold) {
+        next_collection = stats.live * GC_GROWTH_FACTOR;
+        if (next_collection < stats.threshold) {
+            next_collection = stats.threshold;
+        }
+    }
+
+    free(traced.nodes);
+    free(pending.nodes);
+    free(garbage.nodes);
+
+    collecting = false;
+    return garbage.count;
+}
+
+void zlgc_poll(void) {
+    if (stats.threshold && stats.live >= next_collection) {
+        zlgc_collect();
+    }
+}
+
+void zlgc_set_threshold(long threshold) {
+    stats.threshold = threshold;
+    next_collection = threshold;
+}
+
+void zlgc_get_stats(zlgc_stats* s) {
+    *s = stats;
+}
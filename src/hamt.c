@@ -0,0 +1,494 @@
+#include "../include/hamt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/pool.h"
+#include "../include/util.h"
+
+#define HAMT_BITS 5
+#define HAMT_MASK ((1u << HAMT_BITS) - 1)
+/* nodes this deep have used up the hash and list their keys */
+#define HAMT_MAX_SHIFT 32
+
+static inline uint32_t bit_at(unsigned int h, int shift) {
+    return 1u << ((h >> shift) & HAMT_MASK);
+}
+
+static inline int popcount(uint32_t map) {
+    return __builtin_popcount(map);
+}
+
+static inline int index_of(uint32_t map, uint32_t bit) {
+    /* position of bit among the bits set in map */
+    return popcount(map & (bit - 1));
+}
+
+int zlhamt_node_entries(const zlhamt* n) {
+    return n->collisions ? n->collisions : popcount(n->datamap);
+}
+
+int zlhamt_node_children(const zlhamt* n) {
+    return popcount(n->nodemap);
+}
+
+zlhamt** zlhamt_node_child(const zlhamt* n) {
+    return (zlhamt**)(n->entries + zlhamt_node_entries(n));
+}
+
+static size_t node_size(uint32_t datamap, uint32_t nodemap, int collisions) {
+    int entries = collisions ? collisions : popcount(datamap);
+    return sizeof(zlhamt) + sizeof(zlhamt_entry) * entries + sizeof(zlhamt*) * popcount(nodemap);
+}
+
+static zlhamt* node_new(uint32_t datamap, uint32_t nodemap, int collisions) {
+    /* the caller fills in the entries and children */
+    zlhamt* n = zlpool_alloc(node_size(datamap, nodemap, collisions));
+    n->references = 1;
+    n->datamap = datamap;
+    n->nodemap = nodemap;
+    n->collisions = collisions;
+    n->gc_state = ZLGC_UNSEEN;
+    return n;
+}
+
+static void node_free(zlhamt* n) {
+    /* frees n alone, once whatever it held has been moved elsewhere */
+    zlpool_free(n, node_size(n->datamap, n->nodemap, n->collisions));
+}
+
+zlhamt* zlhamt_retain(zlhamt* t) {
+    if (t) {
+        t->references++;
+    }
+    return t;
+}
+
+void zlhamt_release(zlhamt* t) {
+    if (!t || --t->references > 0) {
+        return;
+    }
+    int entries = zlhamt_node_entries(t);
+    for (int i = 0; i < entries; i++) {
+        zlval_del(t->entries[i].key);
+        zlval_del(t->entries[i].val);
+    }
+    zlhamt** child = zlhamt_node_child(t);
+    for (int i = 0; i < zlhamt_node_children(t); i++) {
+        zlhamt_release(child[i]);
+    }
+    node_free(t);
+}
+
+static zlhamt* node_own(zlhamt* n) {
+    /* n, or a copy of it if it is shared, which is then safe to change */
+    if (n->references == 1) {
+        return n;
+    }
+    zlhamt* c = node_new(n->datamap, n->nodemap, n->collisions);
+    memcpy(c->entries, n->entries, node_size(n->datamap, n->nodemap, n->collisions) - sizeof(zlhamt));
+
+    int entries = zlhamt_node_entries(c);
+    for (int i = 0; i < entries; i++) {
+        c->entries[i].key = zlval_copy(c->entries[i].key);
+        c->entries[i].val = zlval_copy(c->entries[i].val);
+    }
+    zlhamt** child = zlhamt_node_child(c);
+    for (int i = 0; i < zlhamt_node_children(c); i++) {
+        child[i]->references++;
+    }
+    n->references--;
+    return c;
+}
+
+static zlhamt_entry entry_new(zlval* k, unsigned int h, zlval* v, unsigned long seq) {
+    zlhamt_entry x = { zlval_copy(k), h, zlval_copy(v), seq };
+    return x;
+}
+
+static inline bool entry_has(const zlhamt_entry* x, const zlval* k, unsigned int h) {
+    /* the cached hashes rule out most keys without comparing them */
+    return x->hash == h && (x->key == k || zlval_eq(x->key, (zlval*)k));
+}
+
+static zlhamt* node_merge(zlhamt_entry a, zlhamt_entry b, int shift) {
+    /* a node holding two entries whose hashes agree below shift */
+    unsigned int ha = a.hash;
+    unsigned int hb = b.hash;
+    if (shift >= HAMT_MAX_SHIFT) {
+        zlhamt* n = node_new(0, 0, 2);
+        n->entries[0] = a;
+        n->entries[1] = b;
+        return n;
+    }
+
+    uint32_t bita = bit_at(ha, shift);
+    uint32_t bitb = bit_at(hb, shift);
+    if (bita == bitb) {
+        zlhamt* n = node_new(0, bita, 0);
+        zlhamt_node_child(n)[0] = node_merge(a, b, shift + HAMT_BITS);
+        return n;
+    }
+
+    zlhamt* n = node_new(bita | bitb, 0, 0);
+    n->entries[bita < bitb ? 0 : 1] = a;
+    n->entries[bita < bitb ? 1 : 0] = b;
+    return n;
+}
+
+static zlhamt* node_replace(zlhamt* n, int i, zlval* v) {
+    /* leaves the entry's key and seq as they were */
+    if (n->entries[i].val == v) {
+        return n;
+    }
+    n = node_own(n);
+    zlval* x = n->entries[i].val;
+    n->entries[i].val = zlval_copy(v);
+    zlval_del(x);
+    return n;
+}
+
+static zlhamt* node_set(zlhamt* n, unsigned int h, int shift, zlval* k, zlval* v, unsigned long* seq, bool* added) {
+    if (n->collisions) {
+        for (int i = 0; i < n->collisions; i++) {
+            if (entry_has(&n->entries[i], k, h)) {
+                *seq = n->entries[i].seq;
+                return node_replace(n, i, v);
+            }
+        }
+        *added = true;
+        n = node_own(n);
+        zlhamt* m = node_new(0, 0, n->collisions + 1);
+        memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * n->collisions);
+        m->entries[n->collisions] = entry_new(k, h, v, *seq);
+        node_free(n);
+        return m;
+    }
+
+    uint32_t bit = bit_at(h, shift);
+    int entries = popcount(n->datamap);
+    int children = popcount(n->nodemap);
+
+    if (n->nodemap & bit) {
+        n = node_own(n);
+        zlhamt** child = zlhamt_node_child(n) + index_of(n->nodemap, bit);
+        *child = node_set(*child, h, shift + HAMT_BITS, k, v, seq, added);
+        return n;
+    }
+
+    if (n->datamap & bit) {
+        int i = index_of(n->datamap, bit);
+        if (entry_has(&n->entries[i], k, h)) {
+            *seq = n->entries[i].seq;
+            return node_replace(n, i, v);
+        }
+
+        /* both keys land here: push them down into a node of their own */
+        *added = true;
+        n = node_own(n);
+        zlhamt* sub = node_merge(n->entries[i], entry_new(k, h, v, *seq), shift + HAMT_BITS);
+
+        zlhamt* m = node_new(n->datamap & ~bit, n->nodemap | bit, 0);
+        memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+        memcpy(m->entries + i, n->entries + i + 1, sizeof(zlhamt_entry) * (entries - i - 1));
+        int j = index_of(n->nodemap, bit);
+        zlhamt** from = zlhamt_node_child(n);
+        zlhamt** to = zlhamt_node_child(m);
+        memcpy(to, from, sizeof(zlhamt*) * j);
+        to[j] = sub;
+        memcpy(to + j + 1, from + j, sizeof(zlhamt*) * (children - j));
+        node_free(n);
+        return m;
+    }
+
+    *added = true;
+    n = node_own(n);
+    int i = index_of(n->datamap, bit);
+    zlhamt* m = node_new(n->datamap | bit, n->nodemap, 0);
+    memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+    m->entries[i] = entry_new(k, h, v, *seq);
+    memcpy(m->entries + i + 1, n->entries + i, sizeof(zlhamt_entry) * (entries - i));
+    memcpy(zlhamt_node_child(m), zlhamt_node_child(n), sizeof(zlhamt*) * children);
+    node_free(n);
+    return m;
+}
+
+zlhamt* zlhamt_set(zlhamt* t, zlval* k, zlval* v, unsigned long* seq, bool* added) {
+    unsigned int h = zlval_hash(k);
+    *added = false;
+    if (!t) {
+        *added = true;
+        t = node_new(bit_at(h, 0), 0, 0);
+        t->entries[0] = entry_new(k, h, v, *seq);
+        return t;
+    }
+    return node_set(t, h, 0, k, v, seq, added);
+}
+
+static bool node_single(const zlhamt* n) {
+    /* a node that is only one entry, which its parent takes in instead */
+    return zlhamt_node_entries(n) == 1 && n->nodemap == 0;
+}
+
+static void entry_del(zlhamt_entry* x) {
+    zlval_del(x->key);
+    zlval_del(x->val);
+}
+
+static zlhamt* node_rm(zlhamt* n, unsigned int h, int shift, const zlval* k) {
+    /* k is somewhere below n; NULL if n is left empty */
+    n = node_own(n);
+
+    if (n->collisions) {
+        int i = 0;
+        while (!entry_has(&n->entries[i], k, h)) {
+            i++;
+        }
+        entry_del(&n->entries[i]);
+        zlhamt* m = node_new(0, 0, n->collisions - 1);
+        memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+        memcpy(m->entries + i, n->entries + i + 1, sizeof(zlhamt_entry) * (n->collisions - i - 1));
+        node_free(n);
+        return m;
+    }
+
+    uint32_t bit = bit_at(h, shift);
+    int entries = popcount(n->datamap);
+    int children = popcount(n->nodemap);
+    zlhamt** from = zlhamt_node_child(n);
+
+    if (n->datamap & bit) {
+        int i = index_of(n->datamap, bit);
+        entry_del(&n->entries[i]);
+        if (entries == 1 && children == 0) {
+            node_free(n);
+            return NULL;
+        }
+        zlhamt* m = node_new(n->datamap & ~bit, n->nodemap, 0);
+        memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+        memcpy(m->entries + i, n->entries + i + 1, sizeof(zlhamt_entry) * (entries - i - 1));
+        memcpy(zlhamt_node_child(m), from, sizeof(zlhamt*) * children);
+        node_free(n);
+        return m;
+    }
+
+    int j = index_of(n->nodemap, bit);
+    zlhamt* sub = node_rm(from[j], h, shift + HAMT_BITS, k);
+    if (sub && !node_single(sub)) {
+        from[j] = sub;
+        return n;
+    }
+    if (!sub && entries == 0 && children == 1) {
+        node_free(n);
+        return NULL;
+    }
+
+    /* drop the child, taking in its last entry if it has one */
+    uint32_t datamap = n->datamap;
+    int i = entries;
+    zlhamt_entry x;
+    if (sub) {
+        x = sub->entries[0];
+        x.key = zlval_copy(x.key);
+        x.val = zlval_copy(x.val);
+        zlhamt_release(sub);
+        datamap |= bit;
+        i = index_of(n->datamap, bit);
+    }
+    zlhamt* m = node_new(datamap, n->nodemap & ~bit, 0);
+    memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+    if (sub) {
+        m->entries[i] = x;
+    }
+    memcpy(m->entries + i + (sub ? 1 : 0), n->entries + i, sizeof(zlhamt_entry) * (entries - i));
+    zlhamt** to = zlhamt_node_child(m);
+    memcpy(to, from, sizeof(zlhamt*) * j);
+    memcpy(to + j, from + j + 1, sizeof(zlhamt*) * (children - j - 1));
+    node_free(n);
+    return m;
+}
+
+static const zlhamt_entry* find(const zlhamt* t, const zlval* k, unsigned int h) {
+    for (int shift = 0; t; shift += HAMT_BITS) {
+        if (t->collisions) {
+            for (int i = 0; i < t->collisions; i++) {
+                if (entry_has(&t->entries[i], k, h)) {
+                    return &t->entries[i];
+                }
+            }
+            return NULL;
+        }
+
+        uint32_t bit = bit_at(h, shift);
+        if (t->datamap & bit) {
+            const zlhamt_entry* x = &t->entries[index_of(t->datamap, bit)];
+            return entry_has(x, k, h) ? x : NULL;
+        }
+        if (!(t->nodemap & bit)) {
+            return NULL;
+        }
+        t = zlhamt_node_child(t)[index_of(t->nodemap, bit)];
+    }
+    return NULL;
+}
+
+zlhamt* zlhamt_rm(zlhamt* t, const zlval* k, unsigned long* seq, bool* removed) {
+    unsigned int h = zlval_hash(k);
+    const zlhamt_entry* x = find(t, k, h);
+    *removed = x != NULL;
+    if (!*removed) {
+        return t;
+    }
+    *seq = x->seq;
+    return node_rm(t, h, 0, k);
+}
+
+zlval* zlhamt_get(const zlhamt* t, const zlval* k) {
+    const zlhamt_entry* x = find(t, k, zlval_hash(k));
+    return x ? x->val : NULL;
+}
+
+static bool node_within(const zlhamt* n, const zlhamt* t) {
+    /* whether t binds every key of n to an equal value; nodes shared by
+     * both tries are skipped without looking inside */
+    if (n == t) {
+        return true;
+    }
+    int entries = zlhamt_node_entries(n);
+    for (int i = 0; i < entries; i++) {
+        const zlhamt_entry* x = &n->entries[i];
+        const zlhamt_entry* y = find(t, x->key, x->hash);
+        if (!y || (x->val != y->val && !zlval_eq(x->val, y->val))) {
+            return false;
+        }
+    }
+    zlhamt** child = zlhamt_node_child(n);
+    for (int i = 0; i < zlhamt_node_children(n); i++) {
+        if (!node_within(child[i], t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool zlhamt_equal(const zlhamt* a, const zlhamt* b) {
+    if (a == b) {
+        return true;
+    }
+    if (!a || !b) {
+        return false;
+    }
+    return node_within(a, b);
+}
+
+static zlhamt* order_set(zlhamt* n, int shift, zlval* k, zlval* v, unsigned long seq) {
+    /* n may be NULL, for a level that isn't there yet */
+    uint32_t bit = 1u << ((seq >> shift) & HAMT_MASK);
+    uint32_t datamap = n ? n->datamap : 0;
+    uint32_t nodemap = n ? n->nodemap : 0;
+
+    if (datamap & bit) {
+        return node_replace(n, index_of(datamap, bit), v);
+    }
+    if (nodemap & bit) {
+        n = node_own(n);
+        zlhamt** child = zlhamt_node_child(n) + index_of(nodemap, bit);
+        *child = order_set(*child, shift - HAMT_BITS, k, v, seq);
+        return n;
+    }
+
+    zlhamt* m;
+    if (shift == 0) {
+        int entries = popcount(datamap);
+        int i = index_of(datamap, bit);
+        m = node_new(datamap | bit, 0, 0);
+        m->entries[i] = entry_new(k, 0, v, seq);
+        if (n) {
+            n = node_own(n);
+            memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+            memcpy(m->entries + i + 1, n->entries + i, sizeof(zlhamt_entry) * (entries - i));
+        }
+    } else {
+        int children = popcount(nodemap);
+        int j = index_of(nodemap, bit);
+        m = node_new(0, nodemap | bit, 0);
+        zlhamt** to = zlhamt_node_child(m);
+        to[j] = order_set(NULL, shift - HAMT_BITS, k, v, seq);
+        if (n) {
+            n = node_own(n);
+            zlhamt** from = zlhamt_node_child(n);
+            memcpy(to, from, sizeof(zlhamt*) * j);
+            memcpy(to + j + 1, from + j, sizeof(zlhamt*) * (children - j));
+        }
+    }
+    if (n) {
+        node_free(n);
+    }
+    return m;
+}
+
+zlhamt* zlhamt_order_set(zlhamt* t, int* shift, zlval* k, zlval* v, unsigned long seq) {
+    /* a seq past what the levels can hold pushes the root down a level */
+    while ((seq >> *shift) > HAMT_MASK) {
+        if (t) {
+            zlhamt* root = node_new(0, 1, 0);
+            zlhamt_node_child(root)[0] = t;
+            t = root;
+        }
+        *shift += HAMT_BITS;
+    }
+    return order_set(t, *shift, k, v, seq);
+}
+
+zlhamt* zlhamt_order_rm(zlhamt* n, int shift, unsigned long seq) {
+    /* NULL if n is left empty */
+    n = node_own(n);
+    uint32_t bit = 1u << ((seq >> shift) & HAMT_MASK);
+
+    zlhamt* m;
+    if (shift == 0) {
+        int entries = popcount(n->datamap);
+        int i = index_of(n->datamap, bit);
+        entry_del(&n->entries[i]);
+        if (entries == 1) {
+            node_free(n);
+            return NULL;
+        }
+        m = node_new(n->datamap & ~bit, 0, 0);
+        memcpy(m->entries, n->entries, sizeof(zlhamt_entry) * i);
+        memcpy(m->entries + i, n->entries + i + 1, sizeof(zlhamt_entry) * (entries - i - 1));
+    } else {
+        int children = popcount(n->nodemap);
+        int j = index_of(n->nodemap, bit);
+        zlhamt** from = zlhamt_node_child(n);
+        zlhamt* sub = zlhamt_order_rm(from[j], shift - HAMT_BITS, seq);
+        if (sub) {
+            from[j] = sub;
+            return n;
+        }
+        if (children == 1) {
+            node_free(n);
+            return NULL;
+        }
+        m = node_new(0, n->nodemap & ~bit, 0);
+        zlhamt** to = zlhamt_node_child(m);
+        memcpy(to, from, sizeof(zlhamt*) * j);
+        memcpy(to + j, from + j + 1, sizeof(zlhamt*) * (children - j - 1));
+    }
+    node_free(n);
+    return m;
+}
+
+void zlhamt_each(const zlhamt* t, zlhamt_visitor f, void* data) {
+    if (!t) {
+        return;
+    }
+    int entries = zlhamt_node_entries(t);
+    for (int i = 0; i < entries; i++) {
+        f(&t->entries[i], data);
+    }
+    zlhamt** child = zlhamt_node_child(t);
+    for (int i = 0; i < zlhamt_node_children(t); i++) {
+        zlhamt_each(child[i], f, data);
+    }
+}
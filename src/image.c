@@ -0,0 +1,908 @@
+#include "../include/image.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/atom.h"
+#include "../include/bigint.h"
+#include "../include/dict.h"
+#include "../include/hamt.h"
+#include "../include/module.h"
+#include "../include/source.h"
+#include "../include/spow.h"
+#include "../include/util.h"
+
+/* An image is a header followed by its forms, each a tag and what the tag
+ * needs, and an END tag. Numbers are written as little endian base 128
+ * varints, signed ones zigzag encoded so small negatives stay short.
+ * Symbols are numbered in the order they first appear: 0 introduces a new
+ * one by its name, and n refers back to the nth. Strings end in a NUL so
+ * they can be used from the mapped image as they are.
+ *
+ * The header holds the magic, the version, the size and hash of the
+ * source and the hash of everything after the header, which is checked
+ * before anything is read so the forms can't be half loaded from an image
+ * that has been cut short.
+ *
+ * A snapshot has the same header without the source, and holds one
+ * environment rather than forms. Environments are numbered like symbols,
+ * except that 0 stands for none and 1 introduces a new one, which is
+ * numbered before its contents so the functions in it can refer back to
+ * it. After its scope come its parent, its locals, with NONE for those
+ * not bound yet, and the names defined in it. Builtins are restored by
+ * name, and functions are their formals, body and frame. The environment
+ * is followed by the files imported into it, each its canonical path and
+ * the modification time the module registry had for it */
+
+#define IMAGE_MAGIC "SPOWIMG1"
+#define SNAPSHOT_MAGIC "SPOWSNP2"
+#define IMAGE_MAGIC_SIZE 8
+
+typedef enum {
+    IMAGE_END,
+    IMAGE_INT,
+    IMAGE_BIGINT,
+    IMAGE_FLOAT,
+    IMAGE_TRUE,
+    IMAGE_FALSE,
+    IMAGE_STR,
+    IMAGE_SYM,
+    IMAGE_QSYM,
+    IMAGE_SEXPR,
+    IMAGE_QEXPR,
+    IMAGE_EEXPR,
+    IMAGE_CEXPR,
+    IMAGE_DICT,
+    IMAGE_ERR,
+    IMAGE_BUILTIN,
+    IMAGE_FN,
+    IMAGE_MACRO,
+    IMAGE_NONE
+} image_tag_t;
+
+struct zlimage {
+    zlsource* src;
+    const unsigned char* pos;
+    const unsigned char* end;
+
+    /* symbols and environments by number */
+    zlatom** atoms;
+    int atom_count;
+    int atom_capacity;
+    zlenv** envs;
+    int env_count;
+    int env_capacity;
+};
+
+/* numbers given to what has been written so far, by address */
+typedef struct {
+    const void** keys;
+    int* numbers;
+    int count;
+    int size;
+} image_numbers;
+
+struct zlimage_writer {
+    FILE* out;
+    char* path;
+    char* tmp;
+    long hash_offset;
+    uint64_t hash;
+    bool failed;
+
+    image_numbers atoms;
+    image_numbers envs;
+};
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t fnv(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static char* image_path(const char* file) {
+    char* path = safe_malloc(strlen(file) + 2);
+    strcpy(path, file);
+    strcat(path, "c");
+    return path;
+}
+
+/* reading */
+
+static bool read_varint(zlimage* img, uint64_t* x) {
+    *x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (img->pos >= img->end) {
+            return false;
+        }
+        unsigned char b = *img->pos++;
+        *x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_u64(zlimage* img, uint64_t* x) {
+    if (img->end - img->pos < 8) {
+        return false;
+    }
+    *x = 0;
+    for (int i = 0; i < 8; i++) {
+        *x |= (uint64_t)img->pos[i] << (8 * i);
+    }
+    img->pos += 8;
+    return true;
+}
+
+static bool read_length(zlimage* img, int* n) {
+    /* a count of things that must fit in what is left */
+    uint64_t x;
+    if (!read_varint(img, &x) || x > (uint64_t)(img->end - img->pos)) {
+        return false;
+    }
+    *n = x;
+    return true;
+}
+
+static zlatom* read_atom(zlimage* img) {
+    uint64_t n;
+    if (!read_varint(img, &n)) {
+        return NULL;
+    }
+    if (n) {
+        return n <= (uint64_t)img->atom_count ? img->atoms[n - 1] : NULL;
+    }
+
+    int length;
+    if (!read_length(img, &length)) {
+        return NULL;
+    }
+    zlatom* a = zlatom_intern_len((const char*)img->pos, length);
+    img->pos += length;
+
+    if (img->atom_count == img->atom_capacity) {
+        img->atom_capacity = img->atom_capacity ? img->atom_capacity * 2 : 64;
+        zlatom** atoms = safe_malloc(sizeof(zlatom*) * img->atom_capacity);
+        if (img->atoms) {
+            memcpy(atoms, img->atoms, sizeof(zlatom*) * img->atom_count);
+            free(img->atoms);
+        }
+        img->atoms = atoms;
+    }
+    img->atoms[img->atom_count++] = a;
+    return a;
+}
+
+static zlval* read_value(zlimage* img, image_tag_t tag);
+static bool read_env(zlimage* img, zlenv** e);
+
+static zlval* read_tagged(zlimage* img) {
+    if (img->pos >= img->end || *img->pos == IMAGE_END) {
+        return NULL;
+    }
+    return read_value(img, *img->pos++);
+}
+
+static zlval* read_value(zlimage* img, image_tag_t tag) {
+    /* NULL if the image doesn't hold a value here */
+    uint64_t x;
+    int n;
+    zlatom* a;
+    zlval* v;
+
+    switch (tag) {
+        case IMAGE_INT:
+            if (!read_varint(img, &x)) {
+                return NULL;
+            }
+            return zlval_int((long)(x >> 1) ^ -(long)(x & 1));
+
+        case IMAGE_BIGINT:
+        {
+            if (!read_length(img, &n) || img->pos >= img->end) {
+                return NULL;
+            }
+            zlbigint* big = safe_malloc(sizeof(zlbigint) + sizeof(uint32_t) * n);
+            big->count = n;
+            big->negative = *img->pos++;
+            for (int i = 0; i < n; i++) {
+                if (!read_varint(img, &x)) {
+                    free(big);
+                    return NULL;
+                }
+                big->limbs[i] = x;
+            }
+            return zlval_bigint(big);
+        }
+
+        case IMAGE_FLOAT:
+        {
+            if (!read_u64(img, &x)) {
+                return NULL;
+            }
+            double d;
+            memcpy(&d, &x, sizeof(d));
+            return zlval_float(d);
+        }
+
+        case IMAGE_TRUE:
+            return zlval_bool(true);
+        case IMAGE_FALSE:
+            return zlval_bool(false);
+
+        case IMAGE_STR:
+            if (!read_length(img, &n) || img->pos + n >= img->end || img->pos[n] != '\0') {
+                return NULL;
+            }
+            v = zlval_str_take((char*)img->pos, n, img->src);
+            img->pos += n + 1;
+            return v;
+
+        case IMAGE_SYM:
+        case IMAGE_QSYM:
+            a = read_atom(img);
+            if (!a) {
+                return NULL;
+            }
+            return tag == IMAGE_SYM ? zlval_sym_atom(a) : zlval_qsym_atom(a);
+
+        case IMAGE_SEXPR:
+        case IMAGE_QEXPR:
+        case IMAGE_EEXPR:
+        case IMAGE_CEXPR:
+            if (!read_length(img, &n)) {
+                return NULL;
+            }
+            v = tag == IMAGE_SEXPR ? zlval_sexpr() :
+                tag == IMAGE_QEXPR ? zlval_qexpr() :
+                tag == IMAGE_EEXPR ? zlval_eexpr() : zlval_cexpr();
+            for (int i = 0; i < n; i++) {
+                zlval* y = read_tagged(img);
+                if (!y) {
+                    zlval_del(v);
+                    return NULL;
+                }
+                v = zlval_add(v, y);
+            }
+            return v;
+
+        case IMAGE_DICT:
+            if (!read_length(img, &n)) {
+                return NULL;
+            }
+            v = zlval_dict();
+            for (int i = 0; i < n; i++) {
+                zlval* k = read_tagged(img);
+                zlval* y = k ? read_tagged(img) : NULL;
+                if (!y) {
+                    if (k) {
+                        zlval_del(k);
+                    }
+                    zlval_del(v);
+                    return NULL;
+                }
+                v = zlval_add_dict(v, k, y);
+                zlval_del(k);
+                zlval_del(y);
+            }
+            return v;
+
+        case IMAGE_ERR:
+            if (!read_length(img, &n) || img->pos + n >= img->end || img->pos[n] != '\0') {
+                return NULL;
+            }
+            v = zlval_err("%s", (const char*)img->pos);
+            img->pos += n + 1;
+            return v;
+
+        case IMAGE_BUILTIN:
+        {
+            if (!read_length(img, &n) || img->pos + n >= img->end || img->pos[n] != '\0') {
+                return NULL;
+            }
+            const char* name = (const char*)img->pos;
+            zlbuiltin builtin = zlbuiltin_lookup(name);
+            img->pos += n + 1;
+            return builtin ? zlval_fun(builtin, name) : NULL;
+        }
+
+        case IMAGE_FN:
+        case IMAGE_MACRO:
+        {
+            zlval* formals = read_tagged(img);
+            zlval* body = formals ? read_tagged(img) : NULL;
+            zlenv* frame = NULL;
+            uint64_t bound;
+            bool ok = body && ISEXPR(formals->type) &&
+                read_varint(img, &bound) && bound <= (uint64_t)formals->count &&
+                read_env(img, &frame) && frame && img->pos < img->end;
+            for (int i = 0; ok && i < formals->count; i++) {
+                ok = formals->cell[i]->type == ZLVAL_SYM;
+            }
+            if (!ok) {
+                if (formals) {
+                    zlval_del(formals);
+                }
+                if (body) {
+                    zlval_del(body);
+                }
+                return NULL;
+            }
+            v = zlval_lambda_frame(tag == IMAGE_FN ? ZLVAL_FN : ZLVAL_MACRO, frame, formals, body);
+            v->bound = bound;
+            v->called = *img->pos++;
+            return v;
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+static bool read_env(zlimage* img, zlenv** e) {
+    /* false if the image doesn't hold an environment here; one that was
+     * written as none is read as NULL */
+    uint64_t n;
+    if (!read_varint(img, &n)) {
+        return false;
+    }
+    if (n != 1) {
+        *e = n ? (n - 2 < (uint64_t)img->env_count ? img->envs[n - 2] : NULL) : NULL;
+        return !n || *e;
+    }
+
+    /* the scope comes first, as the environment is made for it; its
+     * count is one more than its names, or 0 if there is no scope */
+    if (img->pos >= img->end) {
+        return false;
+    }
+    bool top_level = *img->pos++;
+    int count;
+    if (!read_length(img, &count)) {
+        return false;
+    }
+    zlscope* scope = count ? zlscope_new() : NULL;
+    for (int i = 0; i < count - 1; i++) {
+        zlatom* a = read_atom(img);
+        if (!a) {
+            zlscope_release(scope);
+            return false;
+        }
+        zlscope_add(scope, a);
+    }
+    zlenv* env = scope ? zlenv_new_frame(scope) : zlenv_new();
+    if (scope) {
+        zlscope_release(scope);
+    }
+    env->top_level = top_level;
+
+    /* the image keeps the reference it was made with until it is closed */
+    if (img->env_count == img->env_capacity) {
+        img->env_capacity = img->env_capacity ? img->env_capacity * 2 : 64;
+        zlenv** envs = safe_malloc(sizeof(zlenv*) * img->env_capacity);
+        if (img->envs) {
+            memcpy(envs, img->envs, sizeof(zlenv*) * img->env_count);
+            free(img->envs);
+        }
+        img->envs = envs;
+    }
+    img->envs[img->env_count++] = env;
+    *e = env;
+
+    zlenv* parent;
+    if (!read_env(img, &parent)) {
+        return false;
+    }
+    if (parent) {
+        env->parent = parent;
+        parent->references++;
+    }
+
+    for (int i = 0; i < count - 1; i++) {
+        if (img->pos >= img->end) {
+            return false;
+        }
+        if (*img->pos == IMAGE_NONE) {
+            img->pos++;
+            continue;
+        }
+        env->slots[i] = read_tagged(img);
+        if (!env->slots[i]) {
+            return false;
+        }
+    }
+
+    int defined;
+    if (!read_length(img, &defined)) {
+        return false;
+    }
+    for (int i = 0; i < defined; i++) {
+        zlatom* a = read_atom(img);
+        zlval* v = a ? read_tagged(img) : NULL;
+        if (!v) {
+            return false;
+        }
+        zlval* k = zlval_sym_atom(a);
+        zlenv_put(env, k, v);
+        zlval_del(k);
+        zlval_del(v);
+    }
+    return true;
+}
+
+static bool read_preamble(zlimage* img, const char* magic) {
+    /* whether the image starts with magic and this version */
+    if (img->end - img->pos < IMAGE_MAGIC_SIZE || memcmp(img->pos, magic, IMAGE_MAGIC_SIZE)) {
+        return false;
+    }
+    img->pos += IMAGE_MAGIC_SIZE;
+
+    const char* version = get_zl_version();
+    int length;
+    if (!read_length(img, &length) || length != (int)strlen(version) || memcmp(img->pos, version, length)) {
+        return false;
+    }
+    img->pos += length;
+    return true;
+}
+
+static bool read_body_hash(zlimage* img) {
+    /* whether the rest of the image is whole */
+    uint64_t body_hash;
+    return read_u64(img, &body_hash) && body_hash == fnv(FNV_OFFSET, img->pos, img->end - img->pos);
+}
+
+static zlimage* image_map(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    zlsource* src = zlsource_map(fd);
+    close(fd);
+    if (!src) {
+        return NULL;
+    }
+
+    zlimage* img = safe_malloc(sizeof(zlimage));
+    img->src = src;
+    img->pos = (const unsigned char*)src->base;
+    img->end = img->pos + src->size;
+    img->atoms = NULL;
+    img->atom_count = img->atom_capacity = 0;
+    img->envs = NULL;
+    img->env_count = img->env_capacity = 0;
+    return img;
+}
+
+zlimage* zlimage_open(const char* file, const char* source, size_t size) {
+    char* path = image_path(file);
+    zlimage* img = image_map(path);
+    free(path);
+    if (!img) {
+        return NULL;
+    }
+
+    uint64_t source_size, source_hash;
+    if (!read_preamble(img, IMAGE_MAGIC) ||
+        !read_u64(img, &source_size) || source_size != size ||
+        !read_u64(img, &source_hash) || source_hash != fnv(FNV_OFFSET, source, size) ||
+        !read_body_hash(img)) {
+        zlimage_close(img);
+        return NULL;
+    }
+    return img;
+}
+
+int zlimage_next(zlimage* img, zlval** v, char** err) {
+    if (img->pos < img->end && *img->pos == IMAGE_END) {
+        return 0;
+    }
+    *v = read_tagged(img);
+    if (!*v) {
+        /* only if the image was written wrong, as its hash matched */
+        *err = safe_malloc(64);
+        strcpy(*err, "broken image\n");
+        return -1;
+    }
+    return 1;
+}
+
+void zlimage_close(zlimage* img) {
+    for (int i = 0; i < img->env_count; i++) {
+        zlenv_del(img->envs[i]);
+    }
+    zlsource_release(img->src);
+    free(img->atoms);
+    free(img->envs);
+    free(img);
+}
+
+/* writing */
+
+static void write_bytes(zlimage_writer* w, const void* data, size_t size) {
+    w->hash = fnv(w->hash, data, size);
+    if (fwrite(data, 1, size, w->out) != size) {
+        w->failed = true;
+    }
+}
+
+static void write_byte(zlimage_writer* w, unsigned char b) {
+    write_bytes(w, &b, 1);
+}
+
+static void write_varint(zlimage_writer* w, uint64_t x) {
+    unsigned char buf[10];
+    int n = 0;
+    do {
+        buf[n] = x & 0x7f;
+        x >>= 7;
+        if (x) {
+            buf[n] |= 0x80;
+        }
+        n++;
+    } while (x);
+    write_bytes(w, buf, n);
+}
+
+static void write_u64(zlimage_writer* w, uint64_t x) {
+    unsigned char buf[8];
+    for (int i = 0; i < 8; i++) {
+        buf[i] = x >> (8 * i);
+    }
+    write_bytes(w, buf, 8);
+}
+
+static int number_slot(const void** keys, int size, const void* key) {
+    /* linear probing; size is a power of two */
+    int i = (unsigned int)((uintptr_t)key >> 4) * 2654435761u & (size - 1);
+    while (keys[i] && keys[i] != key) {
+        i = (i + 1) & (size - 1);
+    }
+    return i;
+}
+
+static int number_of(image_numbers* m, const void* key) {
+    /* the number key was given, or 0 after giving it the next one */
+    if (m->count + 1 > m->size / 2) {
+        int size = m->size ? m->size * 2 : 256;
+        const void** keys = safe_malloc(sizeof(void*) * size);
+        int* numbers = safe_malloc(sizeof(int) * size);
+        memset(keys, 0, sizeof(void*) * size);
+        for (int i = 0; i < m->size; i++) {
+            if (m->keys[i]) {
+                int j = number_slot(keys, size, m->keys[i]);
+                keys[j] = m->keys[i];
+                numbers[j] = m->numbers[i];
+            }
+        }
+        free(m->keys);
+        free(m->numbers);
+        m->keys = keys;
+        m->numbers = numbers;
+        m->size = size;
+    }
+
+    int i = number_slot(m->keys, m->size, key);
+    if (m->keys[i]) {
+        return m->numbers[i];
+    }
+    m->keys[i] = key;
+    m->numbers[i] = ++m->count;
+    return 0;
+}
+
+static void write_atom(zlimage_writer* w, zlatom* a) {
+    int n = number_of(&w->atoms, a);
+    write_varint(w, n);
+    if (!n) {
+        write_varint(w, a->length);
+        write_bytes(w, a->name, a->length);
+    }
+}
+
+static void write_env(zlimage_writer* w, zlenv* e);
+static void write_value(zlimage_writer* w, const zlval* v);
+
+static void write_entry(const zlhamt_entry* x, void* w) {
+    write_value(w, x->key);
+    write_value(w, x->val);
+}
+
+static void write_value(zlimage_writer* w, const zlval* v) {
+    switch (v->type) {
+        case ZLVAL_INT:
+            write_byte(w, IMAGE_INT);
+            write_varint(w, ((uint64_t)v->lng << 1) ^ (uint64_t)(v->lng >> (sizeof(long) * 8 - 1)));
+            break;
+
+        case ZLVAL_BIGINT:
+            write_byte(w, IMAGE_BIGINT);
+            write_varint(w, v->big->count);
+            write_byte(w, v->big->negative);
+            for (int i = 0; i < v->big->count; i++) {
+                write_varint(w, v->big->limbs[i]);
+            }
+            break;
+
+        case ZLVAL_FLOAT:
+        {
+            uint64_t x;
+            memcpy(&x, &v->dbl, sizeof(x));
+            write_byte(w, IMAGE_FLOAT);
+            write_u64(w, x);
+            break;
+        }
+
+        case ZLVAL_BOOL:
+            write_byte(w, v->bln ? IMAGE_TRUE : IMAGE_FALSE);
+            break;
+
+        case ZLVAL_STR:
+            write_byte(w, IMAGE_STR);
+            write_varint(w, v->length);
+            write_bytes(w, v->str, v->length + 1);
+            break;
+
+        case ZLVAL_SYM:
+        case ZLVAL_QSYM:
+            write_byte(w, v->type == ZLVAL_SYM ? IMAGE_SYM : IMAGE_QSYM);
+            write_atom(w, v->atom);
+            break;
+
+        case ZLVAL_SEXPR:
+        case ZLVAL_QEXPR:
+        case ZLVAL_EEXPR:
+        case ZLVAL_CEXPR:
+            write_byte(w, v->type == ZLVAL_SEXPR ? IMAGE_SEXPR :
+                v->type == ZLVAL_QEXPR ? IMAGE_QEXPR :
+                v->type == ZLVAL_EEXPR ? IMAGE_EEXPR : IMAGE_CEXPR);
+            write_varint(w, v->count);
+            for (int i = 0; i < v->count; i++) {
+                write_value(w, v->cell[i]);
+            }
+            break;
+
+        case ZLVAL_DICT:
+            write_byte(w, IMAGE_DICT);
+            write_varint(w, v->count);
+            zlhamt_each(v->order, write_entry, w);
+            break;
+
+        case ZLVAL_ERR:
+            write_byte(w, IMAGE_ERR);
+            write_varint(w, strlen(v->err));
+            write_bytes(w, v->err, strlen(v->err) + 1);
+            break;
+
+        case ZLVAL_BUILTIN:
+            write_byte(w, IMAGE_BUILTIN);
+            write_varint(w, strlen(v->builtin_name));
+            write_bytes(w, v->builtin_name, strlen(v->builtin_name) + 1);
+            break;
+
+        case ZLVAL_FN:
+        case ZLVAL_MACRO:
+            write_byte(w, v->type == ZLVAL_FN ? IMAGE_FN : IMAGE_MACRO);
+            write_value(w, v->proto->formals);
+            write_value(w, v->proto->body);
+            write_varint(w, v->bound);
+            write_env(w, v->env);
+            write_byte(w, v->called);
+            break;
+    }
+}
+
+static void write_env(zlimage_writer* w, zlenv* e) {
+    if (!e) {
+        write_varint(w, 0);
+        return;
+    }
+    int n = number_of(&w->envs, e);
+    if (n) {
+        write_varint(w, n + 1);
+        return;
+    }
+
+    int count = e->scope ? e->scope->count : 0;
+    write_varint(w, 1);
+    write_byte(w, e->top_level);
+    write_varint(w, e->scope ? count + 1 : 0);
+    for (int i = 0; i < count; i++) {
+        write_atom(w, e->scope->names[i]);
+    }
+
+    write_env(w, e->parent);
+    for (int i = 0; i < count; i++) {
+        if (e->slots[i]) {
+            write_value(w, e->slots[i]);
+        } else {
+            write_byte(w, IMAGE_NONE);
+        }
+    }
+
+    dict* d = e->internal_dict;
+    write_varint(w, d ? dict_count(d) : 0);
+    for (int i = 0; d && i < d->used; i++) {
+        if (d->syms[i]) {
+            write_atom(w, d->syms[i]);
+            write_value(w, d->vals[i]);
+        }
+    }
+}
+
+static zlimage_writer* writer_open(const char* path, const char* magic) {
+    /* writes to a file beside path until it is renamed into place */
+    char* tmp = safe_malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%ld.tmp", path, (long)getpid());
+
+    FILE* out = fopen(tmp, "wb");
+    if (!out) {
+        free(tmp);
+        return NULL;
+    }
+
+    zlimage_writer* w = safe_malloc(sizeof(zlimage_writer));
+    w->out = out;
+    w->path = safe_malloc(strlen(path) + 1);
+    strcpy(w->path, path);
+    w->tmp = tmp;
+    w->failed = false;
+    memset(&w->atoms, 0, sizeof(image_numbers));
+    memset(&w->envs, 0, sizeof(image_numbers));
+
+    const char* version = get_zl_version();
+    write_bytes(w, magic, IMAGE_MAGIC_SIZE);
+    write_varint(w, strlen(version));
+    write_bytes(w, version, strlen(version));
+    return w;
+}
+
+static void writer_begin_body(zlimage_writer* w) {
+    /* the hash of the body is filled in once it has been written */
+    w->hash_offset = ftell(w->out);
+    write_u64(w, 0);
+    w->hash = FNV_OFFSET;
+}
+
+zlimage_writer* zlimage_create(const char* file, const char* source, size_t size) {
+    char* path = image_path(file);
+    zlimage_writer* w = writer_open(path, IMAGE_MAGIC);
+    free(path);
+    if (!w) {
+        return NULL;
+    }
+
+    write_u64(w, size);
+    write_u64(w, fnv(FNV_OFFSET, source, size));
+    writer_begin_body(w);
+    return w;
+}
+
+void zlimage_write(zlimage_writer* w, const zlval* v) {
+    write_value(w, v);
+}
+
+static bool writer_close(zlimage_writer* w, bool save) {
+    if (save) {
+        write_byte(w, IMAGE_END);
+        uint64_t hash = w->hash;
+        if (fseek(w->out, w->hash_offset, SEEK_SET) == 0) {
+            write_u64(w, hash);
+        } else {
+            w->failed = true;
+        }
+    }
+
+    /* renamed into place whole, so other runs never see half an image */
+    bool written = fclose(w->out) == 0 && save && !w->failed;
+    if (written && rename(w->tmp, w->path)) {
+        written = false;
+    }
+    if (!written) {
+        remove(w->tmp);
+    }
+
+    free(w->path);
+    free(w->tmp);
+    free(w->atoms.keys);
+    free(w->atoms.numbers);
+    free(w->envs.keys);
+    free(w->envs.numbers);
+    free(w);
+    return written;
+}
+
+void zlimage_finish(zlimage_writer* w, bool save) {
+    writer_close(w, save);
+}
+
+/* snapshots */
+
+static void write_module(const char* path, const struct timespec* mtime, void* data) {
+    zlimage_writer* w = data;
+    size_t length = strlen(path);
+    write_varint(w, length);
+    write_bytes(w, path, length + 1);
+    write_u64(w, (uint64_t)mtime->tv_sec);
+    write_varint(w, mtime->tv_nsec);
+}
+
+bool zlsnapshot_save(const char* file, zlenv* e) {
+    zlimage_writer* w = writer_open(file, SNAPSHOT_MAGIC);
+    if (!w) {
+        return false;
+    }
+    writer_begin_body(w);
+    write_env(w, e);
+    write_varint(w, zlmodule_count());
+    zlmodule_export(write_module, w);
+    return writer_close(w, true);
+}
+
+static bool read_modules(zlimage* img, const char*** paths, struct timespec** mtimes, int* count) {
+    /* the paths are left in the image */
+    if (!read_length(img, count)) {
+        return false;
+    }
+    *paths = safe_malloc(sizeof(char*) * (*count > 0 ? *count : 1));
+    *mtimes = safe_malloc(sizeof(struct timespec) * (*count > 0 ? *count : 1));
+    for (int i = 0; i < *count; i++) {
+        int n;
+        uint64_t sec;
+        uint64_t nsec;
+        if (!read_length(img, &n) || img->pos + n >= img->end || img->pos[n] != '\0') {
+            return false;
+        }
+        (*paths)[i] = (const char*)img->pos;
+        img->pos += n + 1;
+        if (!read_u64(img, &sec) || !read_varint(img, &nsec) || nsec >= 1000000000) {
+            return false;
+        }
+        (*mtimes)[i].tv_sec = (time_t)sec;
+        (*mtimes)[i].tv_nsec = (long)nsec;
+    }
+    return true;
+}
+
+zlenv* zlsnapshot_load(const char* file) {
+    zlimage* img = image_map(file);
+    if (!img) {
+        return NULL;
+    }
+
+    zlenv* e = NULL;
+    const char** paths = NULL;
+    struct timespec* mtimes = NULL;
+    int count = 0;
+    bool ok = read_preamble(img, SNAPSHOT_MAGIC) && read_body_hash(img) &&
+        read_env(img, &e) && e && e->top_level &&
+        read_modules(img, &paths, &mtimes, &count) &&
+        img->pos < img->end && *img->pos == IMAGE_END;
+
+    /* the top level keeps the reference it was made with, or everything
+     * goes with the image */
+    if (ok) {
+        e->references++;
+        /* the files that defined it are not imported over it again */
+        for (int i = 0; i < count; i++) {
+            zlmodule_restore(paths[i], &mtimes[i]);
+        }
+    } else if (e) {
+        e->top_level = false;
+    }
+    free(paths);
+    free(mtimes);
+    zlimage_close(img);
+    return ok ? e : NULL;
+}
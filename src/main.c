@@ -1,22 +1,57 @@
 #include "../include/spow.h"
+#include "../include/image.h"
 #include "../include/repl.h"
+#include "../include/util.h"
+
+#include <stdio.h>
 
 #ifndef EMSCRIPTEN
 
 int main(int argc, char** argv) {
     setup_zl();
-    zlenv* e = zlenv_new_top_level();
 
-    /* if the only argument is the interpreter name, run repl */
-    if (argc == 1) {
+    /* --snapshot saves the top level environment once the scripts have
+     * run, and --from-snapshot starts from one saved before instead of
+     * setting up a new one */
+    char* save = NULL;
+    char* load = NULL;
+    int first = 1;
+    while (first + 1 < argc) {
+        if (streq(argv[first], "--snapshot")) {
+            save = argv[first + 1];
+        } else if (streq(argv[first], "--from-snapshot")) {
+            load = argv[first + 1];
+        } else {
+            break;
+        }
+        first += 2;
+    }
+
+    zlenv* e = load ? zlsnapshot_load(load) : zlenv_new_top_level();
+    if (!e) {
+        fprintf(stderr, "error: could not restore a snapshot from %s\n", load);
+        teardown_zl();
+        return 1;
+    }
+
+    /* if the only argument is the interpreter name, run repl; run_scripts
+     * skips the first argument, which is the last option's if any */
+    if (first == argc && !save) {
         run_repl(e);
     } else {
-        run_scripts(e, argc, argv);
+        run_scripts(e, argc - first + 1, argv + first - 1);
+    }
+
+    int status = 0;
+
+    if (save && !zlsnapshot_save(save, e)) {
+        fprintf(stderr, "error: could not save a snapshot to %s\n", save);
+        status = 1;
     }
 
     zlenv_del_top_level(e);
     teardown_zl();
-    return 0;
+    return status;
 }
 
 #endif
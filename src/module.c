@@ -0,0 +1,171 @@
+/* for realpath and st_mtim */
+#define _XOPEN_SOURCE 700
+
+#include "../include/module.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../include/atom.h"
+#include "../include/dict.h"
+#include "../include/util.h"
+
+static const char* extensions[] = { ".spow", ".zl", "" };
+#define EXTENSION_COUNT (sizeof(extensions) / sizeof(extensions[0]))
+
+/* directories searched after the name as given, found on the first import
+ * that needs them */
+static char** search_path = NULL;
+static int search_path_count = -1;
+
+/* modification times of the imported files, by canonical path */
+static dict* imported = NULL;
+
+static void search_path_add(const char* dir, size_t length) {
+    search_path = realloc(search_path, sizeof(char*) * (search_path_count + 1));
+    char* copy = safe_malloc(length + 1);
+    memcpy(copy, dir, length);
+    copy[length] = '\0';
+    search_path[search_path_count++] = copy;
+}
+
+static void search_path_load(void) {
+    search_path_count = 0;
+
+    const char* dirs = getenv("SPOW_PATH");
+    while (dirs && *dirs) {
+        size_t length = strcspn(dirs, ":");
+        if (length) {
+            search_path_add(dirs, length);
+        }
+        dirs += length + (dirs[length] == ':');
+    }
+
+    char* base = get_base_path();
+    char* helpers = path_join(base, "helpers");
+    search_path_add(helpers, strlen(helpers));
+    free(base);
+    free(helpers);
+}
+
+static char* find_file(const char* dir, const char* name, bool* exists) {
+    /* the first regular file name names in dir (or as it is, if dir is
+     * NULL) with any of the extensions; exists is set if there is
+     * something there that isn't one */
+    for (size_t i = 0; i < EXTENSION_COUNT; i++) {
+        size_t length = (dir ? strlen(dir) + 1 : 0) + strlen(name) + strlen(extensions[i]) + 1;
+        char* path = safe_malloc(length);
+        snprintf(path, length, "%s%s%s%s", dir ? dir : "", dir ? "/" : "", name, extensions[i]);
+
+        struct stat s;
+        if (stat(path, &s) == 0) {
+            if (S_ISREG(s.st_mode)) {
+                return path;
+            }
+            *exists = true;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+char* zlmodule_resolve(const char* name, zlval** err) {
+    /* only the name as given says why it wasn't found */
+    bool exists = false;
+    char* path = find_file(NULL, name, &exists);
+
+    if (!path && name[0] != '/') {
+        if (search_path_count < 0) {
+            search_path_load();
+        }
+        bool ignored = false;
+        for (int i = 0; !path && i < search_path_count; i++) {
+            path = find_file(search_path[i], name, &ignored);
+        }
+    }
+
+    if (!path) {
+        *err = exists ? zlval_err("path '%s' is not a regular file", name) :
+            zlval_err("path '%s' does not exist", name);
+        return NULL;
+    }
+
+    char* canonical = realpath(path, NULL);
+    free(path);
+    if (!canonical) {
+        *err = zlval_err("path '%s' could not be resolved", name);
+    }
+    return canonical;
+}
+
+static bool mark(const char* path, const struct timespec* when) {
+    /* records path as imported at when, returning false if it already was */
+    if (!imported) {
+        imported = dict_new(NULL, free);
+    }
+    zlatom* k = zlatom_intern(path);
+    struct timespec* mtime = dict_get(imported, k);
+    if (mtime && mtime->tv_sec == when->tv_sec && mtime->tv_nsec == when->tv_nsec) {
+        return false;
+    }
+
+    if (!mtime) {
+        mtime = safe_malloc(sizeof(struct timespec));
+        dict_put(imported, k, mtime);
+    }
+    *mtime = *when;
+    return true;
+}
+
+bool zlmodule_claim(const char* path) {
+    struct stat s;
+    if (stat(path, &s)) {
+        /* left for the import to report */
+        return true;
+    }
+    return mark(path, &s.st_mtim);
+}
+
+void zlmodule_forget(const char* path) {
+    if (imported) {
+        dict_rm(imported, zlatom_intern(path));
+    }
+}
+
+int zlmodule_count(void) {
+    return imported ? dict_count(imported) : 0;
+}
+
+void zlmodule_export(zlmodule_entry_fn f, void* data) {
+    int count = zlmodule_count();
+    if (count == 0) {
+        return;
+    }
+    zlatom** paths = dict_all_keys(imported);
+    void** mtimes = dict_all_vals(imported);
+    for (int i = 0; i < count; i++) {
+        f(paths[i]->name, mtimes[i], data);
+    }
+    free(paths);
+    free(mtimes);
+}
+
+void zlmodule_restore(const char* path, const struct timespec* mtime) {
+    mark(path, mtime);
+}
+
+void zlmodule_teardown(void) {
+    if (imported) {
+        dict_del(imported);
+        imported = NULL;
+    }
+    for (int i = 0; i < search_path_count; i++) {
+        free(search_path[i]);
+    }
+    free(search_path);
+    search_path = NULL;
+    search_path_count = -1;
+}
@@ -1,236 +1,720 @@
 #include "../include/parser.h"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include "../lib/mpc/mpc.h"
-#include "../include/assert.h"
+#include "../include/image.h"
+#include "../include/source.h"
 #include "../include/util.h"
 
-static mpc_parser_t* Integer;
-static mpc_parser_t* FPoint;
-static mpc_parser_t* Number;
-static mpc_parser_t* Bool;
-static mpc_parser_t* String;
-static mpc_parser_t* Comment;
-static mpc_parser_t* Symbol;
-static mpc_parser_t* QSymbol;
-static mpc_parser_t* Sexpr;
-static mpc_parser_t* Qexpr;
-static mpc_parser_t* Dict;
-static mpc_parser_t* EExpr;
-static mpc_parser_t* CExpr;
-static mpc_parser_t* Expr;
-static mpc_parser_t* Zl;
-
-void setup_parser(void) {
-    Integer = mpc_new("integer");
-    FPoint = mpc_new("fpoint");
-    Number = mpc_new("number");
-    Bool = mpc_new("bool");
-    String = mpc_new("string");
-    Comment = mpc_new("comment");
-    Symbol = mpc_new("symbol");
-    QSymbol = mpc_new("qsymbol");
-    Sexpr = mpc_new("sexpr");
-    Qexpr = mpc_new("qexpr");
-    Dict = mpc_new("dict");
-    EExpr = mpc_new("eexpr");
-    CExpr = mpc_new("cexpr");
-    Expr = mpc_new("expr");
-    Zl = mpc_new("zl");
-
-    mpca_lang(MPCA_LANG_DEFAULT,
-        "                                                                   \
-        integer : /[+-]?[0-9]+/ ;                                           \
-        fpoint  : /[+-]?[0-9]+\\.[0-9]*/ | /[+-]?[0-9]*\\.[0-9]+/ ;         \
-        number  : <fpoint> | <integer> ;                                    \
-        bool    : \"true\" | \"false\" ;                                    \
-        string  : /\"(\\\\.|[^\"])*\"/ | /'(\\\\.|[^'])*'/ ;                \
-        comment : /#[^\\r\\n]*/ ;                                           \
-        symbol  : /[a-zA-Z0-9_+\\-*\\/=<>!\\?&%^$]+/ ;                      \
-        qsymbol : ':' <string> | ':' <symbol> ;                             \
-        sexpr   : '(' <expr>* ')' ;                                         \
-        qexpr   : '{' <expr>* '}' ;                                         \
-        dict    : '[' (<qsymbol> <expr>)* ']' ;                             \
-        eexpr   : '\\\\' <expr> ;                                           \
-        cexpr   : '@' <expr> ;                                              \
-        expr    : <number> | <bool> | <string> | <symbol> | <qsymbol> |     \
-                  <comment> | <sexpr> | <qexpr> | <dict> |                  \
-                  <eexpr> | <cexpr> ;                                       \
-        zl      : /^/ <expr>* /$/ ;                                         \
-        ",
-        Integer, FPoint, Number, Bool, String, Comment, Symbol, QSymbol, Sexpr, Qexpr, Dict, EExpr, CExpr, Expr, Zl);
-}
-
-void teardown_parser(void) {
-    mpc_cleanup(13, Integer, FPoint, Number, Bool, String, Comment, Symbol, QSymbol, Sexpr, Qexpr, Dict, EExpr, CExpr, Expr, Zl);
-}
-
-static zlval* zlval_read(const mpc_ast_t* t);
-
-static zlval* zlval_read_int(const mpc_ast_t* t) {
-    errno = 0;
-    long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE ? zlval_int(x) : zlval_err("invalid number: %s", t->contents);
+/* Single pass reader: values are built straight from the input as it is
+ * scanned, and the next character always decides what is read next, so
+ * nothing is ever read twice. The syntax is
+ *
+ *   integer : /[+-]?[0-9]+/
+ *   float   : /[+-]?[0-9]+\.[0-9]*\/ | /[+-]?[0-9]*\.[0-9]+/
+ *   bool    : "true" | "false"
+ *   string  : /"(\\.|[^"])*"/ | /'(\\.|[^'])*'/
+ *   symbol  : /[a-zA-Z0-9_+\-*\/=<>!\?&%^$]+/
+ *   qsymbol : ':' <string> | ':' <symbol>
+ *   sexpr   : '(' <expr>* ')'
+ *   qexpr   : '{' <expr>* '}'
+ *   key     : <number> | <bool> | <string> | <qsymbol> | <qexpr>
+ *   dict    : '[' (<key> <expr>)* ']'
+ *   eexpr   : '\' <expr>
+ *   cexpr   : '@' <expr>
+ *
+ * with the alternatives of an expr tried in that order, so "-1" is a
+ * number and "-" a symbol. Whitespace and comments from '#' to the end of
+ * the line may appear between any two tokens */
+
+struct zlreader {
+    const char* name;
+    /* the file read from, or -1 when reading a string or a file that is
+     * mapped whole as source */
+    int fd;
+    zlsource* source;
+    char* buf;
+    size_t size;
+    bool eof;
+
+    /* the unread input is pos..fill, of which the form being read ends at
+     * end; start is where the buffer starts, at line and col */
+    const char* start;
+    const char* pos;
+    const char* end;
+    const char* fill;
+    int line;
+    int col;
+
+    /* the image forms are read from instead of the source, or the one
+     * they are written to as they are read */
+    zlimage* image;
+    zlimage_writer* out;
+
+    /* set on the first error */
+    char* err;
+};
+
+#define READER_BUFFER_SIZE 65536
+#define READER_ERROR_SIZE 512
+
+static void count_position(const char* from, const char* to, int* line, int* col) {
+    for (const char* c = from; c < to; c++) {
+        if (*c == '\n') {
+            (*line)++;
+            *col = 1;
+        } else {
+            (*col)++;
+        }
+    }
 }
 
-static zlval* zlval_read_float(const mpc_ast_t* t) {
-    errno = 0;
-    double x = strtod(t->contents, NULL);
-    return errno != ERANGE ? zlval_float(x) : zlval_err("invalid float: %s", t->contents);
+static void reader_error(zlreader* r, const char* at, const char* fmt, ...) {
+    if (r->err) {
+        return;
+    }
+
+    /* positions are only worked out for the error */
+    int line = r->line;
+    int col = r->col;
+    count_position(r->start, at, &line, &col);
+
+    char msg[READER_ERROR_SIZE];
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, va);
+    va_end(va);
+
+    r->err = safe_malloc(READER_ERROR_SIZE + strlen(r->name) + 64);
+    sprintf(r->err, "%s:%i:%i: error: %s\n", r->name, line, col, msg);
 }
 
-static zlval* zlval_read_bool(const mpc_ast_t* t) {
-    if (streq(t->contents, "true")) {
-        return zlval_bool(true);
+static inline char peek(const zlreader* r) {
+    return r->pos < r->end ? *r->pos : '\0';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_symbol_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) ||
+        (c != '\0' && strchr("_+-*/=<>!?&%^$", c));
+}
+
+static void skip_space(zlreader* r) {
+    while (r->pos < r->end) {
+        char c = *r->pos;
+        if (c == '#') {
+            while (r->pos < r->end && *r->pos != '\n' && *r->pos != '\r') {
+                r->pos++;
+            }
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v') {
+            r->pos++;
+        } else {
+            return;
+        }
     }
-    return zlval_bool(false);
 }
 
-static zlval* zlval_read_string(const mpc_ast_t* t) {
-    t->contents[strlen(t->contents) - 1] = '\0';
+static char* token_str(const char* from, const char* to) {
+    int n = to - from;
+    char* s = safe_malloc(n + 1);
+    memcpy(s, from, n);
+    s[n] = '\0';
+    return s;
+}
 
-    char* unescaped = safe_malloc(strlen(t->contents + 1) + 1);
-    strcpy(unescaped, t->contents + 1);
+static zlval* read_expr(zlreader* r);
 
-    unescaped = mpcf_unescape(unescaped);
-    zlval* str = zlval_str(unescaped);
+static zlval* read_number(zlreader* r) {
+    /* NULL without moving if no number starts here */
+    const char* p = r->pos;
+    if (p < r->end && (*p == '+' || *p == '-')) {
+        p++;
+    }
+    int whole = 0;
+    while (p < r->end && is_digit(*p)) {
+        p++;
+        whole++;
+    }
+    bool fraction = p < r->end && *p == '.';
+    int decimals = 0;
+    if (fraction) {
+        p++;
+        while (p < r->end && is_digit(*p)) {
+            p++;
+            decimals++;
+        }
+    }
+    if (whole + decimals == 0) {
+        return NULL;
+    }
+
+    const char* from = r->pos;
+    char* s = token_str(from, p);
+    r->pos = p;
 
-    free(unescaped);
-    return str;
+    zlval* x;
+    errno = 0;
+    if (fraction) {
+        double d = strtod(s, NULL);
+        x = errno != ERANGE ? zlval_float(d) : NULL;
+        if (!x) {
+            reader_error(r, from, "invalid float: %s", s);
+        }
+    } else {
+        long l = strtol(s, NULL, 10);
+        if (errno == ERANGE) {
+            /* too large for an INT */
+            zlbigint* big = zlbigint_parse(s);
+            x = big ? zlval_bigint(big) : NULL;
+            if (!x) {
+                reader_error(r, from, "invalid number: %s", s);
+            }
+        } else {
+            x = zlval_int(l);
+        }
+    }
+    free(s);
+    return x;
 }
 
-static zlval* zlval_read_qsym(const mpc_ast_t* t) {
-    if (strstr(t->children[1]->tag, "symbol")) {
-        return zlval_qsym(t->children[1]->contents);
+static bool read_word(zlreader* r, const char* w) {
+    int n = strlen(w);
+    if (r->end - r->pos >= n && memcmp(r->pos, w, n) == 0) {
+        r->pos += n;
+        return true;
     }
+    return false;
+}
 
-    // Handle qsym string form (:'sym')
-    t->children[1]->contents[strlen(t->children[1]->contents) - 1] = '\0';
+static char unescape(char c) {
+    /* the character escaped as \c, or 0 for unknown escapes, which are
+     * kept as they are */
+    switch (c) {
+        case 'a': return '\a';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case '\\': return '\\';
+        case '\'': return '\'';
+        case '"': return '"';
+        default: return '\0';
+    }
+}
 
-    char* unescaped = safe_malloc(strlen(t->children[1]->contents + 1) + 1);
-    strcpy(unescaped, t->children[1]->contents + 1);
-    unescaped = mpcf_unescape(unescaped);
-    zlval* qsym = zlval_qsym(unescaped);
+static bool scan_string(zlreader* r, const char** body, int* length, bool* escapes) {
+    /* moves past the string literal at pos, giving where its contents are
+     * and whether they have any escapes */
+    const char* from = r->pos;
+    char quote = *r->pos++;
+    const char* p = r->pos;
+    *escapes = false;
+    while (p < r->end && *p != quote) {
+        if (*p == '\\' && p + 1 < r->end) {
+            *escapes = true;
+            p++;
+        }
+        p++;
+    }
+    if (p >= r->end) {
+        reader_error(r, from, "unterminated string");
+        return false;
+    }
 
-    free(unescaped);
-    return qsym;
+    *body = r->pos;
+    *length = p - r->pos;
+    r->pos = p + 1;
+    return true;
 }
 
-static zlval* zlval_read_sym(const mpc_ast_t* t) {
-    return zlval_sym(t->contents);
+static char* unescape_string(const char* s, int length, int* unescaped) {
+    char* u = safe_malloc(length + 1);
+    int n = 0;
+    for (const char* c = s; c < s + length; c++) {
+        if (*c == '\\') {
+            if (c[1] == '0') {
+                /* \0 would end the string, so it is dropped */
+                c++;
+                continue;
+            }
+            char e = unescape(c[1]);
+            if (e) {
+                u[n++] = e;
+                c++;
+                continue;
+            }
+        }
+        u[n++] = *c;
+    }
+    u[n] = '\0';
+    *unescaped = n;
+    return u;
 }
 
-static zlval* zlval_read_dict(const mpc_ast_t* t) {
-    zlval* x = zlval_dict();
+static zlval* read_string(zlreader* r) {
+    const char* body;
+    int length;
+    bool escapes;
+    if (!scan_string(r, &body, &length, &escapes)) {
+        return NULL;
+    }
+
+    if (r->source && !escapes) {
+        /* the closing quote becomes the NUL ending the value, which can
+         * then point into the mapped file */
+        char* s = r->source->base + (body - r->start);
+        s[length] = '\0';
+        return zlval_str_take(s, length, r->source);
+    }
 
-    bool new_dict_item = true;
-    zlval* qsym;
-    zlval* val;
+    int n;
+    char* s = unescape_string(body, length, &n);
+    return zlval_str_take(s, n, NULL);
+}
 
-    for (int i = 0; i < t->children_num; i++) {
-        if (streq(t->children[i]->contents, "[")) { continue; }
-        if (streq(t->children[i]->contents, "]")) { continue; }
-        if (streq(t->children[i]->tag, "regex")) { continue; }
-        if (strstr(t->children[i]->tag, "comment")) { continue; }
+static int read_symbol(zlreader* r) {
+    /* moves past the symbol at pos, giving its length */
+    const char* from = r->pos;
+    while (r->pos < r->end && is_symbol_char(*r->pos)) {
+        r->pos++;
+    }
+    return r->pos - from;
+}
 
-        if (new_dict_item) {
-            qsym = zlval_read(t->children[i]);
-            new_dict_item = false;
-        } else {
-            val = zlval_read(t->children[i]);
-            x = zlval_add_dict(x, qsym, val);
-            new_dict_item = true;
+static zlval* read_qsym(zlreader* r) {
+    const char* from = r->pos++;
+    skip_space(r);
 
-            zlval_del(qsym);
-            zlval_del(val);
-        }
+    char c = peek(r);
+    if (is_symbol_char(c)) {
+        int length = read_symbol(r);
+        return zlval_qsym_len(r->pos - length, length);
+    }
+    if (c != '"' && c != '\'') {
+        reader_error(r, from, "expected string or symbol after ':'");
+        return NULL;
     }
 
+    const char* body;
+    int length;
+    bool escapes;
+    if (!scan_string(r, &body, &length, &escapes)) {
+        return NULL;
+    }
+    if (!escapes) {
+        return zlval_qsym_len(body, length);
+    }
+    char* name = unescape_string(body, length, &length);
+    zlval* x = zlval_qsym_len(name, length);
+    free(name);
     return x;
 }
 
-static zlval* zlval_read(const mpc_ast_t* t) {
-    if (strstr(t->tag, "integer")) {
-        return zlval_read_int(t);
+static zlval* read_seq(zlreader* r, zlval* x, char close) {
+    /* adds exprs to x up to the close character */
+    const char* from = r->pos++;
+    while (true) {
+        skip_space(r);
+        char c = peek(r);
+        if (c == close) {
+            r->pos++;
+            return x;
+        }
+        if (c == '\0' && r->pos >= r->end) {
+            reader_error(r, from, "unclosed '%c'; expected '%c'", *from, close);
+            zlval_del(x);
+            return NULL;
+        }
+
+        zlval* y = read_expr(r);
+        if (!y) {
+            zlval_del(x);
+            return NULL;
+        }
+        x = zlval_add(x, y);
     }
-    if (strstr(t->tag, "fpoint")) {
-        return zlval_read_float(t);
+}
+
+static bool is_dict_key(const zlval* k) {
+    switch (k->type) {
+        case ZLVAL_INT:
+        case ZLVAL_BIGINT:
+        case ZLVAL_FLOAT:
+        case ZLVAL_BOOL:
+        case ZLVAL_STR:
+        case ZLVAL_QSYM:
+        case ZLVAL_QEXPR:
+            return zlval_hashable(k);
+        default:
+            return false;
     }
-    if (strstr(t->tag, "bool")) {
-        return zlval_read_bool(t);
+}
+
+static zlval* read_dict(zlreader* r) {
+    const char* from = r->pos++;
+    zlval* x = zlval_dict();
+    while (true) {
+        skip_space(r);
+        char c = peek(r);
+        if (c == ']') {
+            r->pos++;
+            return x;
+        }
+        if (c == '\0' && r->pos >= r->end) {
+            reader_error(r, from, "unclosed '['; expected ']'");
+            zlval_del(x);
+            return NULL;
+        }
+
+        const char* at = r->pos;
+        zlval* k = read_expr(r);
+        if (!k) {
+            zlval_del(x);
+            return NULL;
+        }
+        if (!is_dict_key(k)) {
+            reader_error(r, at, "dict key must be hashable; got %s", zlval_type_name(k->type));
+            zlval_del(k);
+            zlval_del(x);
+            return NULL;
+        }
+
+        skip_space(r);
+        if (peek(r) == ']' || r->pos >= r->end) {
+            reader_error(r, r->pos, "expected value for dict key");
+            zlval_del(k);
+            zlval_del(x);
+            return NULL;
+        }
+        zlval* v = read_expr(r);
+        if (!v) {
+            zlval_del(k);
+            zlval_del(x);
+            return NULL;
+        }
+        x = zlval_add_dict(x, k, v);
+        zlval_del(k);
+        zlval_del(v);
     }
-    if (strstr(t->tag, "string")) {
-        return zlval_read_string(t);
+}
+
+static zlval* read_prefixed(zlreader* r, zlval* x) {
+    /* an E- or C-Expression, around the expr after its prefix */
+    const char* from = r->pos++;
+    skip_space(r);
+    if (r->pos >= r->end || peek(r) == ')' || peek(r) == '}' || peek(r) == ']') {
+        reader_error(r, from, "expected expression after '%c'", *from);
+        zlval_del(x);
+        return NULL;
+    }
+    zlval* y = read_expr(r);
+    if (!y) {
+        zlval_del(x);
+        return NULL;
     }
-    if (strstr(t->tag, "qsymbol")) {
-        return zlval_read_qsym(t);
+    return zlval_add(x, y);
+}
+
+static zlval* read_expr(zlreader* r) {
+    /* the expr at pos, which is not whitespace; NULL on errors */
+    zlval* x = read_number(r);
+    if (x || r->err) {
+        return x;
     }
-    if (strstr(t->tag, "symbol")) {
-        return zlval_read_sym(t);
+    if (read_word(r, "true")) {
+        return zlval_bool(true);
     }
-    if (strstr(t->tag, "dict")) {
-        return zlval_read_dict(t);
+    if (read_word(r, "false")) {
+        return zlval_bool(false);
     }
 
-    zlval* x = NULL;
-    /* If root '>' */
-    if (streq(t->tag, ">")) {
-        x = zlval_sexpr();
+    char c = peek(r);
+    switch (c) {
+        case '"':
+        case '\'':
+            return read_string(r);
+        case ':':
+            return read_qsym(r);
+        case '(':
+            return read_seq(r, zlval_sexpr(), ')');
+        case '{':
+            return read_seq(r, zlval_qexpr(), '}');
+        case '[':
+            return read_dict(r);
+        case '\\':
+            return read_prefixed(r, zlval_eexpr());
+        case '@':
+            return read_prefixed(r, zlval_cexpr());
     }
-    else if (strstr(t->tag, "sexpr")) {
-        x = zlval_sexpr();
+
+    if (is_symbol_char(c)) {
+        int length = read_symbol(r);
+        return zlval_sym_len(r->pos - length, length);
     }
-    else if (strstr(t->tag, "qexpr")) {
-        x = zlval_qexpr();
+
+    if (c == ')' || c == '}' || c == ']') {
+        reader_error(r, r->pos, "unexpected '%c'", c);
+    } else if (c == '\0') {
+        reader_error(r, r->pos, "unexpected NUL character");
+    } else {
+        reader_error(r, r->pos, "unexpected character '%c'", c);
     }
-    else if (strstr(t->tag, "eexpr")) {
-        x = zlval_eexpr();
+    return NULL;
+}
+
+static bool reader_fill(zlreader* r) {
+    /* moves the unread input to the front of the buffer, growing it if it
+     * is full, and reads more after it; false at the end of the input */
+    if (r->eof) {
+        return false;
     }
-    else if (strstr(t->tag, "cexpr")) {
-        x = zlval_cexpr();
+
+    count_position(r->start, r->pos, &r->line, &r->col);
+    size_t unread = r->fill - r->pos;
+    memmove(r->buf, r->pos, unread);
+    if (unread == r->size) {
+        r->size *= 2;
+        char* buf = realloc(r->buf, r->size);
+        if (!buf) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(-1);
+        }
+        r->buf = buf;
     }
+    r->start = r->pos = r->buf;
+    r->fill = r->buf + unread;
 
-    for (int i = 0; i < t->children_num; i++) {
-        if (streq(t->children[i]->contents, "(")) { continue; }
-        if (streq(t->children[i]->contents, ")")) { continue; }
-        if (streq(t->children[i]->contents, "{")) { continue; }
-        if (streq(t->children[i]->contents, "}")) { continue; }
-        if (streq(t->children[i]->contents, ":")) { continue; }
-        if (streq(t->children[i]->contents, "\\")) { continue; }
-        if (streq(t->children[i]->contents, "@")) { continue; }
-        if (streq(t->children[i]->tag, "regex")) { continue; }
-        if (strstr(t->children[i]->tag, "comment")) { continue; }
-        x = zlval_add(x, zlval_read(t->children[i]));
+    ssize_t n;
+    do {
+        n = read(r->fd, r->buf + unread, r->size - unread);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        if (n < 0) {
+            reader_error(r, r->fill, "could not read file: %s", strerror(errno));
+        }
+        r->eof = true;
+        return false;
     }
+    r->fill += n;
+    return true;
+}
 
-    return x;
+static const char* form_end(zlreader* r) {
+    /* the end of the first form after pos: the first whitespace outside of
+     * brackets, strings and comments once a whole token has been seen,
+     * reading more input until there is one. Only the brackets are matched
+     * here; the form itself is checked when it is read */
+    size_t i = 0;
+    int depth = 0;
+    char quote = '\0';
+    bool comment = false;
+    bool token = false;
+    bool prefix = false;
+
+    while (true) {
+        if (r->pos + i >= r->fill) {
+            /* the buffer may move, so only i is kept */
+            if (!reader_fill(r)) {
+                return r->fill;
+            }
+            continue;
+        }
+
+        char c = r->pos[i++];
+        if (quote) {
+            if (c == '\\') {
+                i++;
+            } else if (c == quote) {
+                quote = '\0';
+            }
+            continue;
+        }
+        if (comment) {
+            if (c != '\n' && c != '\r') {
+                continue;
+            }
+            comment = false;
+        }
+
+        switch (c) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+            case '\f':
+            case '\v':
+                /* \, @ and : may be followed by whitespace */
+                if (token && !prefix && depth <= 0) {
+                    return r->pos + i - 1;
+                }
+                continue;
+
+            case '#':
+                comment = true;
+                continue;
+
+            case '\\':
+            case '@':
+            case ':':
+                token = prefix = true;
+                continue;
+
+            case '"':
+            case '\'':
+                quote = c;
+                break;
+
+            case '(':
+            case '{':
+            case '[':
+                depth++;
+                break;
+
+            case ')':
+            case '}':
+            case ']':
+                depth--;
+                break;
+        }
+        token = true;
+        prefix = false;
+    }
 }
 
-bool zlval_parse(const char* input, zlval** v, char** err) {
-    mpc_result_t r;
-    if (mpc_parse("<stdin>", input, Zl, &r)) {
-        *v = zlval_read(r.output);
-        mpc_ast_delete(r.output);
-        return true;
+zlreader* zlreader_open(const char* file, bool cache, char** err) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        *err = safe_malloc(strlen(file) + 64);
+        sprintf(*err, "%s: error: could not open file\n", file);
+        return NULL;
+    }
+
+    zlreader* r = safe_malloc(sizeof(zlreader));
+    char* name = safe_malloc(strlen(file) + 1);
+    strcpy(name, file);
+    r->name = name;
+    r->line = r->col = 1;
+    r->err = NULL;
+
+    /* regular files are mapped and read in one go, while the rest are read
+     * through the buffer a bit at a time */
+    r->source = zlsource_map(fd);
+    r->image = NULL;
+    r->out = NULL;
+    if (r->source) {
+        close(fd);
+        r->fd = -1;
+        r->size = 0;
+        r->buf = NULL;
+        r->eof = true;
+        r->start = r->pos = r->end = r->source->base;
+        r->fill = r->source->base + r->source->size;
+
+#if SPOW_IMAGES
+        if (cache) {
+            r->image = zlimage_open(file, r->source->base, r->source->size);
+            if (!r->image) {
+                r->out = zlimage_create(file, r->source->base, r->source->size);
+            }
+        }
+#endif
     } else {
-        *err = mpc_err_string(r.error);
-        mpc_err_delete(r.error);
-        return false;
+        r->fd = fd;
+        r->size = READER_BUFFER_SIZE;
+        r->buf = safe_malloc(r->size);
+        r->eof = false;
+        r->start = r->pos = r->end = r->fill = r->buf;
     }
+    return r;
 }
 
-bool zlval_parse_file(const char* file, zlval** v, char** err) {
-    mpc_result_t r;
-    if (mpc_parse_contents(file, Zl, &r)) {
-        *v = zlval_read(r.output);
-        mpc_ast_delete(r.output);
-        return true;
-    } else {
-        *err = mpc_err_string(r.error);
-        mpc_err_delete(r.error);
+void zlreader_close(zlreader* r) {
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    if (r->source) {
+        zlsource_detach(r->source);
+        zlsource_release(r->source);
+    }
+    if (r->image) {
+        zlimage_close(r->image);
+    }
+    if (r->out) {
+        zlimage_finish(r->out, false);
+    }
+    free((char*)r->name);
+    free(r->buf);
+    free(r->err);
+    free(r);
+}
+
+int zlreader_next(zlreader* r, zlval** v, char** err) {
+    if (r->image) {
+        return zlimage_next(r->image, v, err);
+    }
+
+    r->end = form_end(r);
+    if (!r->err) {
+        skip_space(r);
+        if (r->pos >= r->end) {
+            /* only saved once the whole file has been read */
+            if (r->out) {
+                zlimage_finish(r->out, true);
+                r->out = NULL;
+            }
+            return 0;
+        }
+        *v = read_expr(r);
+    }
+
+    if (r->err) {
+        *err = r->err;
+        r->err = NULL;
+        return -1;
+    }
+    if (r->out) {
+        zlimage_write(r->out, *v);
+    }
+    return 1;
+}
+
+bool zlval_parse(const char* input, zlval** v, char** err) {
+    zlreader r = {
+        .name = "<stdin>",
+        .fd = -1,
+        .source = NULL,
+        .image = NULL,
+        .out = NULL,
+        .eof = true,
+        .start = input,
+        .pos = input,
+        .fill = input + strlen(input),
+        .line = 1,
+        .col = 1,
+    };
+
+    zlval* x = zlval_sexpr();
+    zlval* y;
+    int status;
+    while ((status = zlreader_next(&r, &y, err)) > 0) {
+        x = zlval_add(x, y);
+    }
+    if (status < 0) {
+        zlval_del(x);
         return false;
     }
+    *v = x;
+    return true;
 }
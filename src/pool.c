@@ -0,0 +1,104 @@
+#include "../include/pool.h"
+
+#include <stdlib.h>
+
+#include "../include/util.h"
+
+#define POOL_GRANULARITY 16
+#define POOL_CLASSES 8
+#define POOL_SLAB_OBJECTS 256
+
+typedef struct zlpool_node {
+    struct zlpool_node* next;
+} zlpool_node;
+
+typedef struct zlpool_slab {
+    struct zlpool_slab* next;
+} zlpool_slab;
+
+/* Small fixed size nodes (values, environments, dict headers) are carved out
+ * of slabs, one free list per size class. Slabs are only given back to the
+ * system on teardown */
+typedef struct {
+    zlpool_node* free[POOL_CLASSES];
+    zlpool_slab* slabs;
+    zlpool_stats stats;
+} zlpool;
+
+static zlpool pool;
+
+#if SPOW_POOL
+static int size_class(size_t size) {
+    return (int)((size + POOL_GRANULARITY - 1) / POOL_GRANULARITY) - 1;
+}
+
+static void grow_class(int c) {
+    size_t size = (size_t)(c + 1) * POOL_GRANULARITY;
+    zlpool_slab* slab = safe_malloc(POOL_GRANULARITY + size * POOL_SLAB_OBJECTS);
+    slab->next = pool.slabs;
+    pool.slabs = slab;
+
+    char* p = (char*)slab + POOL_GRANULARITY;
+    for (int i = 0; i < POOL_SLAB_OBJECTS; i++) {
+        zlpool_node* n = (zlpool_node*)(p + i * size);
+        n->next = pool.free[c];
+        pool.free[c] = n;
+    }
+
+    pool.stats.slabs++;
+    pool.stats.capacity += POOL_SLAB_OBJECTS;
+}
+#endif
+
+void* zlpool_alloc(size_t size) {
+    pool.stats.live++;
+    pool.stats.allocs++;
+    if (pool.stats.live > pool.stats.peak) {
+        pool.stats.peak = pool.stats.live;
+    }
+
+#if SPOW_POOL
+    int c = size_class(size);
+    if (c < POOL_CLASSES) {
+        if (!pool.free[c]) {
+            grow_class(c);
+        }
+        zlpool_node* n = pool.free[c];
+        pool.free[c] = n->next;
+        return n;
+    }
+#endif
+    return safe_malloc(size);
+}
+
+void zlpool_free(void* p, size_t size) {
+    pool.stats.live--;
+
+#if SPOW_POOL
+    int c = size_class(size);
+    if (c < POOL_CLASSES) {
+        zlpool_node* n = p;
+        n->next = pool.free[c];
+        pool.free[c] = n;
+        return;
+    }
+#endif
+    free(p);
+}
+
+void zlpool_get_stats(zlpool_stats* s) {
+    *s = pool.stats;
+}
+
+void zlpool_teardown(void) {
+    /* releases every slab at once, along with whatever still lives in them */
+    while (pool.slabs) {
+        zlpool_slab* next = pool.slabs->next;
+        free(pool.slabs);
+        pool.slabs = next;
+    }
+    for (int i = 0; i < POOL_CLASSES; i++) {
+        pool.free[i] = NULL;
+    }
+    pool.stats.slabs = pool.stats.capacity = 0;
+}
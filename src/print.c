@@ -6,6 +6,7 @@
 
 #include "../lib/mpc/mpc.h"
 #include "../include/assert.h"
+#include "../include/hamt.h"
 #include "../include/util.h"
 
 #define BUFSIZE 4096
@@ -61,26 +62,26 @@ static void zlval_expr_print(stringbuilder_t* sb, const zlval* v, const char* op
     stringbuilder_write(sb, close);
 }
 
-static void zlval_dict_print(stringbuilder_t* sb, const dict* d) {
-    stringbuilder_write(sb, "[");
-
-    int count = dict_count(d);
-    char** keys = dict_all_keys(d);
-    zlval** vals = (zlval**)dict_all_vals(d);
+typedef struct {
+    stringbuilder_t* sb;
+    bool first;
+} entry_printer;
 
-    for (int i = 0; i < count; i++) {
-        stringbuilder_write(sb, ":'%s'", keys[i]);
-        stringbuilder_write(sb, " ");
-        zlval_write_sb(sb, vals[i]);
-
-        if (i != (count - 1)) {
-            stringbuilder_write(sb, " ");
-        }
+static void zlval_entry_print(const zlhamt_entry* x, void* data) {
+    entry_printer* p = data;
+    if (!p->first) {
+        stringbuilder_write(p->sb, " ");
     }
+    p->first = false;
+    zlval_write_sb(p->sb, x->key);
+    stringbuilder_write(p->sb, " ");
+    zlval_write_sb(p->sb, x->val);
+}
 
-    free(keys);
-    free(vals);
-
+static void zlval_dict_print(stringbuilder_t* sb, const zlval* v) {
+    stringbuilder_write(sb, "[");
+    entry_printer p = { sb, true };
+    zlhamt_each(v->order, zlval_entry_print, &p);
     stringbuilder_write(sb, "]");
 }
 
@@ -104,6 +105,14 @@ static void zlval_write_sb(stringbuilder_t* sb, const zlval* v) {
             stringbuilder_write(sb, "%li", v->lng);
             break;
 
+        case ZLVAL_BIGINT:
+        {
+            char* digits = zlbigint_to_str(v->big);
+            stringbuilder_write(sb, "%s", digits);
+            free(digits);
+            break;
+        }
+
         case ZLVAL_FLOAT:
             stringbuilder_write(sb, "%f", v->dbl);
             break;
@@ -133,23 +142,31 @@ static void zlval_write_sb(stringbuilder_t* sb, const zlval* v) {
             break;
 
         case ZLVAL_FN:
+        {
+            zlval* formals = zlval_unbound_formals(v);
             stringbuilder_write(sb, "(fn ");
-            zlval_write_sb(sb, v->formals);
+            zlval_write_sb(sb, formals);
             stringbuilder_write(sb, " ");
-            zlval_write_sb(sb, v->body);
+            zlval_write_sb(sb, v->proto->body);
             stringbuilder_write(sb, ")");
+            zlval_del(formals);
             break;
+        }
 
         case ZLVAL_MACRO:
+        {
+            zlval* formals = zlval_unbound_formals(v);
             stringbuilder_write(sb, "(macro ");
-            zlval_write_sb(sb, v->formals);
+            zlval_write_sb(sb, formals);
             stringbuilder_write(sb, " ");
-            zlval_write_sb(sb, v->body);
+            zlval_write_sb(sb, v->proto->body);
             stringbuilder_write(sb, ")");
+            zlval_del(formals);
             break;
+        }
 
         case ZLVAL_DICT:
-            zlval_dict_print(sb, v->d);
+            zlval_dict_print(sb, v);
             break;
 
         case ZLVAL_SEXPR:
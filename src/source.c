@@ -0,0 +1,61 @@
+/* for posix_madvise and MAP_ANONYMOUS */
+#define _DEFAULT_SOURCE
+
+#include "../include/source.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/util.h"
+
+zlsource* zlsource_map(int fd) {
+    struct stat s;
+    if (fstat(fd, &s) || !S_ISREG(s.st_mode) || s.st_size == 0) {
+        return NULL;
+    }
+
+    char* base = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    /* the reader goes through it once from the start */
+    posix_madvise(base, s.st_size, POSIX_MADV_SEQUENTIAL);
+
+    zlsource* src = safe_malloc(sizeof(zlsource));
+    src->references = 1;
+    src->base = base;
+    src->size = s.st_size;
+    return src;
+}
+
+void zlsource_detach(zlsource* s) {
+    /* the contents are put in memory of their own at the same address, so
+     * the strings pointing into them are left as they are */
+    if (s->references == 1) {
+        return;
+    }
+    char* copy = safe_malloc(s->size);
+    memcpy(copy, s->base, s->size);
+    if (mmap(s->base, s->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        /* the old mapping may be gone with it */
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(-1);
+    }
+    memcpy(s->base, copy, s->size);
+    free(copy);
+}
+
+zlsource* zlsource_retain(zlsource* s) {
+    s->references++;
+    return s;
+}
+
+void zlsource_release(zlsource* s) {
+    if (--s->references == 0) {
+        munmap(s->base, s->size);
+        free(s);
+    }
+}
@@ -6,15 +6,19 @@
 #include <time.h>
 
 #include "../include/assert.h"
+#include "../include/atom.h"
 #include "../include/builtins.h"
+#include "../include/module.h"
 #include "../include/parser.h"
+#include "../include/pool.h"
 #include "../include/print.h"
 #include "../include/util.h"
+#include "../include/vm.h"
 
 void run_scripts(zlenv* e, int argc, char** argv) {
     for (int i = 1; i < argc; i++) {
         zlval* args = zlval_add(zlval_sexpr(), zlval_str(argv[i]));
-        zlval* x = builtin_import(e, args);
+        zlval* x = builtin_run_script(e, args);
 
         if (x->type == ZLVAL_ERR) {
             zlval_println(x);
@@ -26,11 +30,13 @@ void run_scripts(zlenv* e, int argc, char** argv) {
 void setup_zl(void) {
     srand(time(NULL));
     register_default_print_fn();
-    setup_parser();
 }
 
 void teardown_zl(void) {
-    teardown_parser();
+    zlmodule_teardown();
+    zlvm_teardown();
+    zlpool_teardown();
+    zlatom_teardown();
 }
 
 char* get_zl_version(void) {
@@ -6,16 +6,28 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
 
 #include "../include/assert.h"
 #include "../include/builtins.h"
+#include "../include/compile.h"
+#include "../include/gc.h"
+#include "../include/hamt.h"
+#include "../include/pool.h"
 #include "../include/print.h"
+#include "../include/source.h"
 #include "../include/util.h"
 
+#define ZLVAL_CELLS_MIN_CAPACITY 4
+#define ZLVAL_CELLS_GROWTH_FACTOR 2
+#define ZLVAL_CELLS_SHRINK_RATIO 4
+
 char* zlval_type_name(zlval_type_t t) {
     switch (t) {
         case ZLVAL_ERR: return "Error";
         case ZLVAL_INT: return "Integer";
+        case ZLVAL_BIGINT: return "Big Integer";
         case ZLVAL_FLOAT: return "Float";
         case ZLVAL_BUILTIN: return "Builtin";
         case ZLVAL_FN: return "Function";
@@ -37,6 +49,7 @@ char* zlval_type_sysname(zlval_type_t t) {
     switch (t) {
         case ZLVAL_ERR: return "err";
         case ZLVAL_INT: return "int";
+        case ZLVAL_BIGINT: return "bigint";
         case ZLVAL_FLOAT: return "float";
         case ZLVAL_BUILTIN: return "builtin";
         case ZLVAL_FN: return "fn";
@@ -60,6 +73,8 @@ zlval_type_t zlval_parse_sysname(const char* sysname) {
         return ZLVAL_INT;
     } else if (streq(sysname, "float")) {
         return ZLVAL_FLOAT;
+    } else if (streq(sysname, "bigint")) {
+        return ZLVAL_BIGINT;
     } else if (streq(sysname, "str")) {
         return ZLVAL_STR;
     } else if (streq(sysname, "bool")) {
@@ -92,8 +107,15 @@ zlval_type_t zlval_parse_sysname(const char* sysname) {
     }
 }
 
+static zlval* zlval_new(void) {
+    zlval* v = zlpool_alloc(sizeof(zlval));
+    v->references = 1;
+    v->gc_state = ZLGC_UNSEEN;
+    return v;
+}
+
 zlval* zlval_err(const char* fmt, ...) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_ERR;
 
     va_list va;
@@ -112,72 +134,161 @@ zlval* zlval_err(const char* fmt, ...) {
 }
 
 zlval* zlval_int(long x) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_INT;
     v->lng = x;
     return v;
 }
 
+zlval* zlval_bigint(zlbigint* x) {
+    /* takes x; integers that fit are demoted to plain INTs */
+    long lng;
+    if (zlbigint_to_long(x, &lng)) {
+        free(x);
+        return zlval_int(lng);
+    }
+    zlval* v = zlval_new();
+    v->type = ZLVAL_BIGINT;
+    v->big = x;
+    return v;
+}
+
 zlval* zlval_float(double x) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_FLOAT;
     v->dbl = x;
     return v;
 }
 
-static zlval* zlval_sym_base(const char* s) {
-    zlval* v = safe_malloc(sizeof(zlval));
-    v->length = strlen(s);
-    v->sym = safe_malloc(strlen(s) + 1);
-    strcpy(v->sym, s);
+static zlval* zlval_sym_base(zlval_type_t type, zlatom* atom) {
+    zlval* v = zlval_new();
+    v->type = type;
+    v->atom = atom;
+    v->sym = v->atom->name;
+    v->length = v->atom->length;
     return v;
 }
 
 zlval* zlval_sym(const char* s) {
-    zlval* v = zlval_sym_base(s);
-    v->type = ZLVAL_SYM;
-    return v;
+    return zlval_sym_base(ZLVAL_SYM, zlatom_intern(s));
 }
 
 zlval* zlval_qsym(const char* s) {
-    zlval* v = zlval_sym_base(s);
-    v->type = ZLVAL_QSYM;
-    return v;
+    return zlval_sym_base(ZLVAL_QSYM, zlatom_intern(s));
+}
+
+zlval* zlval_sym_len(const char* s, int length) {
+    return zlval_sym_base(ZLVAL_SYM, zlatom_intern_len(s, length));
+}
+
+zlval* zlval_qsym_len(const char* s, int length) {
+    return zlval_sym_base(ZLVAL_QSYM, zlatom_intern_len(s, length));
+}
+
+zlval* zlval_sym_atom(zlatom* atom) {
+    return zlval_sym_base(ZLVAL_SYM, atom);
+}
+
+zlval* zlval_qsym_atom(zlatom* atom) {
+    return zlval_sym_base(ZLVAL_QSYM, atom);
 }
 
 zlval* zlval_str(const char* s) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    int length = strlen(s);
+    char* str = safe_malloc(length + 1);
+    memcpy(str, s, length + 1);
+    return zlval_str_take(str, length, NULL);
+}
+
+zlval* zlval_str_take(char* s, int length, zlsource* source) {
+    zlval* v = zlval_new();
     v->type = ZLVAL_STR;
-    v->length = strlen(s);
-    v->str = safe_malloc(v->length + 1);
-    strcpy(v->str, s);
+    v->length = length;
+    v->str = s;
+    v->source = source ? zlsource_retain(source) : NULL;
     return v;
 }
 
+static void zlval_str_free(zlval* v) {
+    if (v->source) {
+        zlsource_release(v->source);
+    } else {
+        free(v->str);
+    }
+}
+
+static void zlval_str_set(zlval* v, char* s) {
+    /* replaces the string of v, which isn't shared, with the allocated s */
+    zlval_str_free(v);
+    v->str = s;
+    v->source = NULL;
+}
+
 zlval* zlval_bool(bool b) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_BOOL;
     v->bln = b;
     return v;
 }
 
 zlval* zlval_fun(const zlbuiltin builtin, const char* builtin_name) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_BUILTIN;
     v->builtin = builtin;
     v->builtin_name = safe_malloc(strlen(builtin_name) + 1);
     strcpy(v->builtin_name, builtin_name);
+    zlbuiltin_arity(builtin, &v->min_args, &v->max_args);
     return v;
 }
 
+static zlproto* zlproto_new(zlval* formals, zlval* body) {
+    zlproto* p = zlpool_alloc(sizeof(zlproto));
+    p->references = 1;
+    p->formals = formals;
+    p->body = body;
+    p->chunk = zlchunk_new();
+
+    p->arity = formals->count;
+    p->variadic = false;
+    p->expansions = 0;
+    for (int i = 0; i < formals->count; i++) {
+        if (streq(formals->cell[i]->sym, "&")) {
+            p->arity = i;
+            p->variadic = true;
+            break;
+        }
+    }
+    return p;
+}
+
+static void zlproto_release(zlproto* p) {
+    p->references--;
+    if (p->references <= 0) {
+        zlval_del(p->formals);
+        zlval_del(p->body);
+        zlchunk_release(p->chunk);
+        zlpool_free(p, sizeof(zlproto));
+    }
+}
+
 zlval* zlval_lambda(zlenv* closure, zlval* formals, zlval* body) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_FN;
-    v->env = zlenv_new();
+
+    /* formals get a slot each in the frame, in order */
+    zlscope* scope = zlscope_new();
+    for (int i = 0; i < formals->count; i++) {
+        if (!streq(formals->cell[i]->sym, "&")) {
+            zlscope_add(scope, formals->cell[i]->atom);
+        }
+    }
+    v->env = zlenv_new_frame(scope);
+    zlscope_release(scope);
+
     v->env->parent = closure;
     v->env->parent->references++;
-    v->formals = formals;
-    v->body = body;
+    v->proto = zlproto_new(formals, body);
+    v->bound = 0;
     v->called = false;
     return v;
 }
@@ -188,6 +299,19 @@ zlval* zlval_macro(zlenv* closure, zlval* formals, zlval* body) {
     return v;
 }
 
+zlval* zlval_lambda_frame(zlval_type_t type, zlenv* frame, zlval* formals, zlval* body) {
+    /* for functions whose frame was made elsewhere, along with whatever
+     * it has bound */
+    zlval* v = zlval_new();
+    v->type = type;
+    v->env = frame;
+    v->env->references++;
+    v->proto = zlproto_new(formals, body);
+    v->bound = 0;
+    v->called = false;
+    return v;
+}
+
 static void* zlval_copy_proxy(const void* v) {
     return zlval_copy(v);
 }
@@ -197,55 +321,108 @@ static void zlval_del_proxy(void* v) {
 }
 
 zlval* zlval_dict(void) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_DICT;
     v->count = 0;
     v->length = 0;
-    v->d = dict_new(zlval_copy_proxy, zlval_del_proxy);
+    v->map = NULL;
+    v->seq = 0;
+    v->order = NULL;
+    v->order_shift = 0;
     return v;
 }
 
 zlval* zlval_sexpr(void) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_SEXPR;
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->vec = NULL;
+    v->evaluated = false;
+    v->plain = true;
+    v->expansion = NULL;
+    v->expanded_by = NULL;
     return v;
 }
 
 zlval* zlval_qexpr(void) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_QEXPR;
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->vec = NULL;
+    v->evaluated = false;
+    v->plain = true;
+    v->expansion = NULL;
+    v->expanded_by = NULL;
     return v;
 }
 
 zlval* zlval_eexpr(void) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_EEXPR;
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->vec = NULL;
+    v->evaluated = false;
+    v->plain = true;
+    v->expansion = NULL;
+    v->expanded_by = NULL;
     return v;
 }
 
 zlval* zlval_cexpr(void) {
-    zlval* v = safe_malloc(sizeof(zlval));
+    zlval* v = zlval_new();
     v->type = ZLVAL_CEXPR;
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->vec = NULL;
+    v->evaluated = false;
+    v->plain = true;
+    v->expansion = NULL;
+    v->expanded_by = NULL;
     return v;
 }
 
+static zlvec* zlvec_new(int capacity, int front) {
+    zlvec* s = safe_malloc(sizeof(zlvec) + sizeof(zlval*) * capacity);
+    s->references = 1;
+    s->capacity = capacity;
+    s->front = front;
+    s->back = front;
+    s->gc_state = ZLGC_UNSEEN;
+    return s;
+}
+
+static void zlvec_release(zlvec* s) {
+    s->references--;
+    if (s->references > 0) {
+        return;
+    }
+    for (int i = s->front; i < s->back; i++) {
+        zlval_del(s->slots[i]);
+    }
+    free(s);
+}
+
 void zlval_del(zlval* v) {
+    v->references--;
+    if (v->references > 0) {
+        return;
+    }
+
     switch (v->type) {
         case ZLVAL_INT:
             break;
 
+        case ZLVAL_BIGINT:
+            free(v->big);
+            break;
+
         case ZLVAL_FLOAT:
             break;
 
@@ -256,8 +433,7 @@ void zlval_del(zlval* v) {
         case ZLVAL_FN:
         case ZLVAL_MACRO:
             zlenv_del(v->env);
-            zlval_del(v->formals);
-            zlval_del(v->body);
+            zlproto_release(v->proto);
             break;
 
         case ZLVAL_ERR:
@@ -266,119 +442,281 @@ void zlval_del(zlval* v) {
 
         case ZLVAL_SYM:
         case ZLVAL_QSYM:
-            free(v->sym);
             break;
 
         case ZLVAL_STR:
-            free(v->str);
+            zlval_str_free(v);
             break;
 
         case ZLVAL_BOOL:
             break;
 
         case ZLVAL_DICT:
-            dict_del(v->d);
+            zlhamt_release(v->map);
+            zlhamt_release(v->order);
             break;
 
         case ZLVAL_EEXPR:
         case ZLVAL_SEXPR:
         case ZLVAL_QEXPR:
         case ZLVAL_CEXPR:
-            for (int i = 0; i < v->count; i++) {
-                zlval_del(v->cell[i]);
+            if (v->vec) {
+                zlvec_release(v->vec);
             }
-            free(v->cell);
+            zlval_set_expansion(v, NULL, NULL);
             break;
     }
 
-    free(v);
+    zlpool_free(v, sizeof(zlval));
+}
+
+static int zlval_cells_start(const zlval* v) {
+    return v->cell - v->vec->slots;
+}
+
+static void zlval_cells_trim(zlval* v) {
+    /* drops the cells of unshared storage that v doesn't view */
+    zlvec* s = v->vec;
+    int start = zlval_cells_start(v);
+    int end = start + v->count;
+    for (int i = s->front; i < start; i++) {
+        zlval_del(s->slots[i]);
+    }
+    for (int i = end; i < s->back; i++) {
+        zlval_del(s->slots[i]);
+    }
+    s->front = start;
+    s->back = end;
+}
+
+static void zlval_cells_move(zlval* v, int capacity, int front) {
+    /* moves the cells v views to front in new storage of capacity slots */
+    zlvec* s = zlvec_new(capacity, front);
+    if (v->vec && v->vec->references == 1) {
+        zlval_cells_trim(v);
+        memcpy(s->slots + front, v->cell, sizeof(zlval*) * v->count);
+        v->vec->front = v->vec->back = 0;
+        zlvec_release(v->vec);
+    } else if (v->vec) {
+        for (int i = 0; i < v->count; i++) {
+            s->slots[front + i] = zlval_copy(v->cell[i]);
+        }
+        zlvec_release(v->vec);
+    }
+    s->back = front + v->count;
+    v->vec = s;
+    v->cell = s->slots + front;
+}
+
+static int zlval_cells_grow(const zlval* v, int needed) {
+    int capacity = v->vec ? v->vec->capacity : ZLVAL_CELLS_MIN_CAPACITY;
+    while (capacity < needed) {
+        capacity *= ZLVAL_CELLS_GROWTH_FACTOR;
+    }
+    return capacity;
+}
+
+static void zlval_cells_own(zlval* v) {
+    /* makes v the only value viewing its storage, so cells can be replaced */
+    if (!v->vec) {
+        return;
+    }
+    if (v->vec->references == 1) {
+        zlval_cells_trim(v);
+    } else if (v->count) {
+        zlval_cells_move(v, v->count, 0);
+    } else {
+        zlvec_release(v->vec);
+        v->vec = NULL;
+        v->cell = NULL;
+    }
+}
+
+static void zlval_cells_reserve_back(zlval* v) {
+    if (v->vec) {
+        zlvec* s = v->vec;
+        int end = zlval_cells_start(v) + v->count;
+        if (s->back == end && end < s->capacity) {
+            /* nothing else views the next slot */
+            return;
+        }
+        if (s->references == 1) {
+            zlval_cells_trim(v);
+            if (end < s->capacity) {
+                return;
+            }
+            if (v->count + 1 <= s->capacity / 2) {
+                /* reclaim the room left at the front by popped cells */
+                zlval_cells_move(v, s->capacity, 0);
+                return;
+            }
+        }
+    }
+    zlval_cells_move(v, zlval_cells_grow(v, (v->count + 1) * ZLVAL_CELLS_GROWTH_FACTOR), 0);
+}
+
+static void zlval_cells_reserve_front(zlval* v) {
+    int capacity = 0;
+    if (v->vec) {
+        zlvec* s = v->vec;
+        int start = zlval_cells_start(v);
+        if (s->front == start && start > 0) {
+            return;
+        }
+        if (s->references == 1) {
+            zlval_cells_trim(v);
+            if (start > 0) {
+                return;
+            }
+            if (v->count + 1 <= s->capacity / 2) {
+                capacity = s->capacity;
+            }
+        }
+    }
+    if (!capacity) {
+        capacity = zlval_cells_grow(v, (v->count + 1) * ZLVAL_CELLS_GROWTH_FACTOR);
+    }
+    /* lists built with cons grow at the front, so leave half the free
+     * room there */
+    int slack = capacity - v->count;
+    zlval_cells_move(v, capacity, slack - slack / 2);
+}
+
+static void zlval_cells_maybe_shrink(zlval* v) {
+    int capacity = v->vec->capacity;
+    if (capacity > ZLVAL_CELLS_MIN_CAPACITY && v->count < capacity / ZLVAL_CELLS_SHRINK_RATIO) {
+        capacity = v->count * ZLVAL_CELLS_GROWTH_FACTOR;
+        zlval_cells_move(v, capacity < ZLVAL_CELLS_MIN_CAPACITY ? ZLVAL_CELLS_MIN_CAPACITY : capacity, 0);
+    }
 }
 
+static zlval* zlval_detach(zlval* v);
+
 zlval* zlval_add(zlval* v, zlval* x) {
+    v = zlval_detach(v);
+    zlval_cells_reserve_back(v);
+    v->plain = v->plain && zlval_is_plain(x);
+    v->cell[v->count] = x;
+    v->vec->back++;
     v->count++;
     v->length++;
-    v->cell = realloc(v->cell, sizeof(zlval*) * v->count);
-    v->cell[v->count - 1] = x;
+    return v;
+}
+
+zlval* zlval_reserve(zlval* v, int n) {
+    v = zlval_detach(v);
+    if (n <= 0) {
+        return v;
+    }
+    if (v->vec) {
+        zlvec* s = v->vec;
+        if (s->references == 1) {
+            zlval_cells_trim(v);
+        }
+        if (s->back == zlval_cells_start(v) + v->count && s->back + n <= s->capacity) {
+            return v;
+        }
+    }
+    zlval_cells_move(v, zlval_cells_grow(v, v->count + n), 0);
     return v;
 }
 
 zlval* zlval_add_front(zlval* v, zlval* x) {
+    v = zlval_detach(v);
+    zlval_cells_reserve_front(v);
+    v->plain = v->plain && zlval_is_plain(x);
+    v->cell--;
+    v->vec->front--;
+    v->cell[0] = x;
     v->count++;
     v->length++;
-    v->cell = realloc(v->cell, sizeof(zlval*) * v->count);
-    if (v->count > 1) {
-        memmove(&v->cell[1], &v->cell[0], sizeof(zlval*) * (v->count - 1));
-    }
-    v->cell[0] = x;
     return v;
 }
 
 zlval* zlval_add_dict(zlval* x, zlval* k, zlval* v) {
-    dict_put(x->d, k->sym, v);
-    x->count = x->length = dict_count(x->d);
+    /* x shares its trie with the dict it was copied from, which only
+     * copies the nodes on the path to k */
+    x = zlval_unshare(x);
+    unsigned long seq = x->seq;
+    bool added;
+    x->map = zlhamt_set(x->map, k, v, &seq, &added);
+    x->order = zlhamt_order_set(x->order, &x->order_shift, k, v, seq);
+    if (added) {
+        x->seq++;
+        x->count = x->length = x->count + 1;
+    }
     return x;
 }
 
 zlval* zlval_get_dict(zlval* x, zlval* k) {
-    return dict_get(x->d, k->sym);
+    zlval* v = zlhamt_get(x->map, k);
+    return v ? zlval_copy(v) : NULL;
 }
 
 zlval* zlval_rm_dict(zlval* x, zlval* k) {
-    dict_rm(x->d, k->sym);
-    x->count = x->length = dict_count(x->d);
+    x = zlval_unshare(x);
+    unsigned long seq;
+    bool removed;
+    x->map = zlhamt_rm(x->map, k, &seq, &removed);
+    if (removed) {
+        x->order = zlhamt_order_rm(x->order, x->order_shift, seq);
+        x->count = x->length = x->count - 1;
+    }
     return x;
 }
 
 bool zlval_haskey_dict(zlval* x, zlval* k) {
-    return dict_index(x->d, k->sym) != -1;
+    return zlhamt_get(x->map, k) != NULL;
 }
 
-zlval* zlval_keys_dict(zlval* x) {
-    int count = dict_count(x->d);
-    char** keys = dict_all_keys(x->d);
+static void add_key(const zlhamt_entry* x, void* v) {
+    zlval_add(v, zlval_copy(x->key));
+}
 
-    zlval* v = zlval_qexpr();
-    for (int i = 0; i < count; i++) {
-        zlval_add(v, zlval_qsym(keys[i]));
-    }
+static void add_val(const zlhamt_entry* x, void* v) {
+    zlval_add(v, zlval_copy(x->val));
+}
 
-    free(keys);
+zlval* zlval_keys_dict(zlval* x) {
+    zlval* v = zlval_qexpr();
+    zlhamt_each(x->order, add_key, v);
     return v;
 }
 
 zlval* zlval_vals_dict(zlval* x) {
-    int count = dict_count(x->d);
-    zlval** vals = (zlval**)dict_all_vals(x->d);
-
     zlval* v = zlval_qexpr();
-    for (int i = 0; i < count; i++) {
-        zlval_add(v, zlval_copy(vals[i]));
-    }
-
-    free(vals);
+    zlhamt_each(x->order, add_val, v);
     return v;
 }
 
 zlval* zlval_pop(zlval* v, int i) {
+    /* v must not be shared */
+    zlval_cells_own(v);
     zlval* x = v->cell[i];
 
-    memmove(&v->cell[i], &v->cell[i + 1], sizeof(zlval*) * (v->count - i - 1));
+    if (i == 0) {
+        v->cell++;
+        v->vec->front++;
+    } else {
+        memmove(&v->cell[i], &v->cell[i + 1], sizeof(zlval*) * (v->count - i - 1));
+        v->vec->back--;
+    }
     v->count--;
     v->length--;
 
-    v->cell = realloc(v->cell, sizeof(zlval*) * v->count);
+    zlval_cells_maybe_shrink(v);
     return x;
 }
 
 zlval* zlval_take(zlval* v, int i) {
-    zlval* x = zlval_pop(v, i);
+    zlval* x = zlval_copy(v->cell[i]);
     zlval_del(v);
     return x;
 }
 
 zlval* zlval_join(zlval* x, zlval* y) {
-    while (y->count) {
-        x = zlval_add(x, zlval_pop(y, 0));
+    for (int i = 0; i < y->count; i++) {
+        x = zlval_add(x, zlval_copy(y->cell[i]));
     }
 
     zlval_del(y);
@@ -386,19 +724,29 @@ zlval* zlval_join(zlval* x, zlval* y) {
 }
 
 zlval* zlval_insert(zlval* x, zlval* y, int i) {
+    x = zlval_unshare(x);
+    zlval_cells_reserve_back(x);
+    x->vec->back++;
     x->count++;
     x->length++;
-    x->cell = realloc(x->cell, sizeof(zlval*) * x->count);
 
     memmove(&x->cell[i + 1], &x->cell[i], sizeof(zlval*) * (x->count - i - 1));
     x->cell[i] = y;
+    x->plain = x->plain && zlval_is_plain(y);
     return x;
 }
 
 zlval* zlval_shift(zlval* x, zlval* y, int i) {
-    while (y->count) {
-        x = zlval_insert(x, zlval_pop(y, y->count - 1), i);
+    /* the cells after i are moved once to make room for all of y */
+    x = zlval_reserve(zlval_unshare(x), y->count);
+    memmove(&x->cell[i + y->count], &x->cell[i], sizeof(zlval*) * (x->count - i));
+    for (int j = 0; j < y->count; j++) {
+        x->cell[i + j] = zlval_copy(y->cell[j]);
+        x->plain = x->plain && zlval_is_plain(y->cell[j]);
     }
+    x->vec->back += y->count;
+    x->count += y->count;
+    x->length += y->count;
 
     zlval_del(y);
     return x;
@@ -406,24 +754,25 @@ zlval* zlval_shift(zlval* x, zlval* y, int i) {
 
 static zlval* zlval_reverse_qexpr(zlval* x) {
     zlval* y = zlval_qexpr();
-    while (x->count) {
-        y = zlval_add(y, zlval_pop(x, x->count - 1));
+    for (int i = x->count - 1; i >= 0; i--) {
+        y = zlval_add(y, zlval_copy(x->cell[i]));
     }
     zlval_del(x);
     return y;
 }
 
 static zlval* zlval_reverse_qsym(zlval* x) {
+    x = zlval_unshare(x);
     char* reversed = strrev(x->sym);
-    free(x->sym);
-    x->sym = reversed;
+    x->atom = zlatom_intern(reversed);
+    x->sym = x->atom->name;
+    free(reversed);
     return x;
 }
 
 static zlval* zlval_reverse_str(zlval* x) {
-    char* reversed = strrev(x->str);
-    free(x->str);
-    x->str = reversed;
+    x = zlval_unshare(x);
+    zlval_str_set(x, strrev(x->str));
     return x;
 }
 
@@ -437,55 +786,50 @@ zlval* zlval_reverse(zlval* x) {
     }
 }
 
+static zlval* zlval_view(zlval* x, int start, int end) {
+    /* a collection of the same cells from start to end */
+    x = zlval_detach(x);
+    x->cell += start;
+    x->count = x->length = end - start;
+    return x;
+}
+
 static zlval* zlval_slice_step_qexpr(zlval* x, int start, int end, int step) {
-    /* Remove from front */
-    while (start) {
-        zlval_del(zlval_pop(x, 0));
-        start--; end--;
-    }
-    /* Remove from back */
-    while (end < x->count) {
-        zlval_del(zlval_pop(x, end));
-    }
-    /* Remove by steps */
-    if (step > 1 && x->count) {
-        int final_count = x->count / step + (x->count % step == 0 ? 0 : 1),
-            multiplier = 0,
-            removal_offset = 0;
-
-        while (x->count > final_count) {
-            for (int i = 1; i < step; i++) {
-                int idx = multiplier * step + i - removal_offset;
-                zlval_del(zlval_pop(x, idx));
-                removal_offset++;
-            }
-            multiplier++;
-        }
+    if (step == 1) {
+        return zlval_view(x, start, end);
     }
-    return x;
+
+    zlval* y = zlval_qexpr();
+    for (int i = start; i < end; i += step) {
+        y = zlval_add(y, zlval_copy(x->cell[i]));
+    }
+    zlval_del(x);
+    return y;
 }
 
 static zlval* zlval_slice_step_str(zlval* x, int start, int end, int step) {
+    x = zlval_unshare(x);
     char* sliced = strsubstr(x->str, start, end);
     if (step > 1 && strlen(sliced)) {
         char* stepped = strstep(sliced, step);
         free(sliced);
         sliced = stepped;
     }
-    free(x->str);
-    x->str = sliced;
+    zlval_str_set(x, sliced);
     return x;
 }
 
 static zlval* zlval_slice_step_qsym(zlval* x, int start, int end, int step) {
+    x = zlval_unshare(x);
     char* sliced = strsubstr(x->sym, start, end);
     if (step > 1 && strlen(sliced)) {
         char* stepped = strstep(sliced, step);
         free(sliced);
         sliced = stepped;
     }
-    free(x->sym);
-    x->sym = sliced;
+    x->atom = zlatom_intern(sliced);
+    x->sym = x->atom->name;
+    free(sliced);
     return x;
 }
 
@@ -503,6 +847,14 @@ zlval* zlval_slice(zlval* x, int start, int end) {
     return zlval_slice_step(x, start, end, 1);
 }
 
+double zlval_to_double(const zlval* x) {
+    switch (x->type) {
+        case ZLVAL_INT: return (double)x->lng;
+        case ZLVAL_BIGINT: return zlbigint_to_double(x->big);
+        default: return x->dbl;
+    }
+}
+
 void zlval_maybe_promote_numeric(zlval* a, zlval* b) {
     if (!(ISNUMERIC(a->type) && ISNUMERIC(b->type))) {
         return;
@@ -514,21 +866,33 @@ void zlval_maybe_promote_numeric(zlval* a, zlval* b) {
 }
 
 void zlval_promote_numeric(zlval* x) {
-    if (x->type != ZLVAL_FLOAT) {
+    if (x->type == ZLVAL_BIGINT) {
+        double d = zlbigint_to_double(x->big);
+        free(x->big);
+        x->type = ZLVAL_FLOAT;
+        x->dbl = d;
+    } else if (x->type != ZLVAL_FLOAT) {
         x->type = ZLVAL_FLOAT;
         x->dbl = (double)x->lng;
     }
 }
 
 void zlval_demote_numeric(zlval* x) {
-    if (x->type != ZLVAL_INT) {
+    if (x->type == ZLVAL_FLOAT) {
         x->type = ZLVAL_INT;
         x->lng = (long)x->dbl;
     }
 }
 
 zlval* zlval_copy(const zlval* v) {
-    zlval* x = safe_malloc(sizeof(zlval));
+    zlval* x = (zlval*)v;
+    x->references++;
+    return x;
+}
+
+static zlval* zlval_clone(const zlval* v) {
+    /* one level deep; everything below is shared with v */
+    zlval* x = zlval_new();
     x->type = v->type;
 
     switch (v->type) {
@@ -536,13 +900,16 @@ zlval* zlval_copy(const zlval* v) {
             x->builtin = v->builtin;
             x->builtin_name = safe_malloc(strlen(v->builtin_name) + 1);
             strcpy(x->builtin_name, v->builtin_name);
+            x->min_args = v->min_args;
+            x->max_args = v->max_args;
             break;
 
         case ZLVAL_FN:
         case ZLVAL_MACRO:
             x->env = zlenv_copy(v->env);
-            x->formals = zlval_copy(v->formals);
-            x->body = zlval_copy(v->body);
+            x->proto = v->proto;
+            x->proto->references++;
+            x->bound = v->bound;
             x->called = v->called;
             break;
 
@@ -550,6 +917,10 @@ zlval* zlval_copy(const zlval* v) {
             x->lng = v->lng;
             break;
 
+        case ZLVAL_BIGINT:
+            x->big = zlbigint_copy(v->big);
+            break;
+
         case ZLVAL_FLOAT:
             x->dbl = v->dbl;
             break;
@@ -562,14 +933,22 @@ zlval* zlval_copy(const zlval* v) {
         case ZLVAL_SYM:
         case ZLVAL_QSYM:
             x->length = v->length;
-            x->sym = safe_malloc(strlen(v->sym) + 1);
-            strcpy(x->sym, v->sym);
+            x->sym = v->sym;
+            x->atom = v->atom;
             break;
 
         case ZLVAL_STR:
+            /* strings in a mapped source are never changed there, so
+             * the clone can point at the same chars */
             x->length = v->length;
-            x->str = safe_malloc(strlen(v->str) + 1);
-            strcpy(x->str, v->str);
+            if (v->source) {
+                x->str = v->str;
+                x->source = zlsource_retain(v->source);
+            } else {
+                x->str = safe_malloc(strlen(v->str) + 1);
+                strcpy(x->str, v->str);
+                x->source = NULL;
+            }
             break;
 
         case ZLVAL_BOOL:
@@ -579,7 +958,10 @@ zlval* zlval_copy(const zlval* v) {
         case ZLVAL_DICT:
             x->count = v->count;
             x->length = v->length;
-            x->d = dict_copy(v->d);
+            x->map = zlhamt_retain(v->map);
+            x->seq = v->seq;
+            x->order = zlhamt_retain(v->order);
+            x->order_shift = v->order_shift;
             break;
 
         case ZLVAL_SEXPR:
@@ -588,16 +970,71 @@ zlval* zlval_copy(const zlval* v) {
         case ZLVAL_CEXPR:
             x->count = v->count;
             x->length = v->length;
-            x->cell = safe_malloc(sizeof(zlval*) * x->count);
-            for (int i = 0; i < x->count; i++) {
-                x->cell[i] = zlval_copy(v->cell[i]);
+            x->evaluated = false;
+            x->plain = v->plain;
+            x->vec = v->vec;
+            x->cell = v->cell;
+            if (x->vec) {
+                x->vec->references++;
             }
+            x->expansion = NULL;
+            x->expanded_by = NULL;
             break;
     }
 
     return x;
 }
 
+static zlval* zlval_detach(zlval* v) {
+    /* unshares v itself; a collection still shares its cells */
+    if (v->references == 1) {
+        /* about to be changed, after which a call site is no longer the
+         * form its expansion was made from */
+        if (v->type == ZLVAL_SEXPR && v->expansion) {
+            zlval_set_expansion(v, NULL, NULL);
+        }
+        return v;
+    }
+    zlval* x = zlval_clone(v);
+    v->references--;
+    return x;
+}
+
+zlval* zlval_unshare(zlval* v) {
+    v = zlval_detach(v);
+    if (ISEXPR(v->type) || v->type == ZLVAL_EEXPR || v->type == ZLVAL_CEXPR) {
+        /* the caller may replace cells directly */
+        zlval_cells_own(v);
+        v->plain = false;
+    }
+    return v;
+}
+
+void zlval_set_expansion(zlval* site, zlval* m, zlval* x) {
+    /* both are held, so m can't be freed and another macro take its
+     * place; NULL drops the expansion kept before */
+    zlval* expansion = site->expansion;
+    zlval* expanded_by = site->expanded_by;
+    site->expansion = x ? zlval_copy(x) : NULL;
+    site->expanded_by = m ? zlval_copy(m) : NULL;
+    if (expansion) {
+        zlval_del(expansion);
+        zlval_del(expanded_by);
+    }
+}
+
+zlval* zlval_unbound_formals(const zlval* f) {
+    const zlval* formals = f->proto->formals;
+    return zlval_view(zlval_copy(formals), f->bound, formals->count);
+}
+
+bool zlval_is_plain(const zlval* v) {
+    if (v->type == ZLVAL_EEXPR || v->type == ZLVAL_CEXPR) {
+        return false;
+    }
+    return !ISEXPR(v->type) || v->plain;
+}
+
 zlval* zlval_convert(zlval_type_t t, const zlval* v) {
     if (v->type == t) {
         return zlval_copy(v);
@@ -606,7 +1043,14 @@ zlval* zlval_convert(zlval_type_t t, const zlval* v) {
     switch (t) {
         case ZLVAL_INT:
             switch (v->type) {
+                case ZLVAL_BIGINT:
+                    return zlval_copy(v);
+                    break;
+
                 case ZLVAL_FLOAT:
+                    if (isfinite(v->dbl) && (v->dbl < (double)LONG_MIN || v->dbl >= -(double)LONG_MIN)) {
+                        return zlval_bigint(zlbigint_from_double(v->dbl));
+                    }
                     return zlval_int((long)v->dbl);
                     break;
 
@@ -615,6 +1059,12 @@ zlval* zlval_convert(zlval_type_t t, const zlval* v) {
                         errno = 0;
                         char* strend = v->str;
                         long x = strtol(v->str, &strend, 10);
+                        if (errno == ERANGE && *strend == '\0') {
+                            zlbigint* big = zlbigint_parse(v->str);
+                            if (big) {
+                                return zlval_bigint(big);
+                            }
+                        }
                         return errno != ERANGE && *strend == '\0' ? zlval_int(x) : zlval_err("invalid number: %s", v->str);
                     }
                     break;
@@ -636,6 +1086,10 @@ zlval* zlval_convert(zlval_type_t t, const zlval* v) {
                     return zlval_float((double)v->lng);
                     break;
 
+                case ZLVAL_BIGINT:
+                    return zlval_float(zlbigint_to_double(v->big));
+                    break;
+
                 case ZLVAL_STR:
                     {
                         errno = 0;
@@ -673,6 +1127,11 @@ zlval* zlval_convert(zlval_type_t t, const zlval* v) {
                     return zlval_bool(v->lng != 0 ? true : false);
                     break;
 
+                case ZLVAL_BIGINT:
+                    /* never zero, which would fit an INT */
+                    return zlval_bool(true);
+                    break;
+
                 case ZLVAL_FLOAT:
                     return zlval_bool(v->dbl != 0.0 ? true : false);
                     break;
@@ -704,7 +1163,16 @@ zlval* zlval_convert(zlval_type_t t, const zlval* v) {
 }
 
 bool zlval_eq(zlval* x, zlval* y) {
-    zlval_maybe_promote_numeric(x, y);
+    if (ISINTEGER(x->type) && ISINTEGER(y->type) && x->type != y->type) {
+        /* a BIGINT never fits an INT */
+        return false;
+    }
+    if (ISNUMERIC(x->type) && ISNUMERIC(y->type) && x->type != y->type) {
+        /* compare as floats, without promoting values that may be shared */
+        double a = zlval_to_double(x);
+        double b = zlval_to_double(y);
+        return a == b;
+    }
     if (x->type != y->type) {
         return false;
     }
@@ -716,13 +1184,30 @@ bool zlval_eq(zlval* x, zlval* y) {
 
         case ZLVAL_FN:
         case ZLVAL_MACRO:
-            return y->type == x->type && zlval_eq(x->formals, y->formals) && zlval_eq(x->body, y->body);
+        {
+            if (y->type != x->type) {
+                return false;
+            }
+            if (x->proto == y->proto && x->bound == y->bound) {
+                return true;
+            }
+            zlval* xf = zlval_unbound_formals(x);
+            zlval* yf = zlval_unbound_formals(y);
+            bool eq = zlval_eq(xf, yf) && zlval_eq(x->proto->body, y->proto->body);
+            zlval_del(xf);
+            zlval_del(yf);
+            return eq;
             break;
+        }
 
         case ZLVAL_INT:
             return x->lng == y->lng;
             break;
 
+        case ZLVAL_BIGINT:
+            return zlbigint_cmp(x->big, y->big) == 0;
+            break;
+
         case ZLVAL_FLOAT:
             return x->dbl == y->dbl;
             break;
@@ -733,7 +1218,7 @@ bool zlval_eq(zlval* x, zlval* y) {
 
         case ZLVAL_SYM:
         case ZLVAL_QSYM:
-            return x->length == y->length && streq(x->sym, y->sym);
+            return x->atom == y->atom;
             break;
 
         case ZLVAL_STR:
@@ -745,7 +1230,7 @@ bool zlval_eq(zlval* x, zlval* y) {
             break;
 
         case ZLVAL_DICT:
-            return dict_equal(x->d, y->d);
+            return x->count == y->count && zlhamt_equal(x->map, y->map);
             break;
 
         case ZLVAL_SEXPR:
@@ -766,19 +1251,161 @@ bool zlval_eq(zlval* x, zlval* y) {
     return false;
 }
 
+bool zlval_hashable(const zlval* v) {
+    /* values that can be dict keys: those compared by their contents,
+     * which nothing can change behind the dict's back */
+    switch (v->type) {
+        case ZLVAL_INT:
+        case ZLVAL_BIGINT:
+        case ZLVAL_FLOAT:
+        case ZLVAL_SYM:
+        case ZLVAL_QSYM:
+        case ZLVAL_STR:
+        case ZLVAL_BOOL:
+            return true;
+
+        case ZLVAL_QEXPR:
+            for (int i = 0; i < v->count; i++) {
+                if (!zlval_hashable(v->cell[i])) {
+                    return false;
+                }
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static unsigned int hash_mix(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static unsigned int hash_number(double d) {
+    /* numbers of any type that compare equal are equal as doubles, and
+     * the integral ones hash by their integer value */
+    unsigned long bits;
+    if (d >= (double)LONG_MIN && d < -(double)LONG_MIN && d == (double)(long)d) {
+        bits = (unsigned long)(long)d;
+    } else {
+        memcpy(&bits, &d, sizeof(bits));
+    }
+    return hash_mix((unsigned int)bits ^ (unsigned int)(bits >> 32));
+}
+
+unsigned int zlval_hash(const zlval* v) {
+    /* consistent with zlval_eq for the values zlval_hashable accepts */
+    unsigned int h = hash_mix(v->type + 1);
+    switch (v->type) {
+        case ZLVAL_INT:
+        case ZLVAL_BIGINT:
+        case ZLVAL_FLOAT:
+            return hash_number(zlval_to_double(v));
+
+        case ZLVAL_SYM:
+        case ZLVAL_QSYM:
+            return hash_mix(h ^ v->atom->hash);
+
+        case ZLVAL_STR:
+            /* FNV-1a */
+            for (const char* c = v->str; *c; c++) {
+                h = (h ^ (unsigned char)*c) * 0x01000193u;
+            }
+            return hash_mix(h);
+
+        case ZLVAL_BOOL:
+            return hash_mix(h ^ v->bln);
+
+        case ZLVAL_QEXPR:
+            for (int i = 0; i < v->count; i++) {
+                h = (h ^ zlval_hash(v->cell[i])) * 0x01000193u;
+            }
+            return hash_mix(h);
+
+        default:
+            return h;
+    }
+}
+
 bool is_zlval_empty_qexpr(zlval* x) {
     return x->type == ZLVAL_QEXPR && x->count == 0;
 }
 
+zlscope* zlscope_new(void) {
+    zlscope* s = safe_malloc(sizeof(zlscope));
+    s->count = 0;
+    s->names = NULL;
+    s->references = 1;
+    return s;
+}
+
+zlscope* zlscope_retain(zlscope* s) {
+    s->references++;
+    return s;
+}
+
+void zlscope_release(zlscope* s) {
+    s->references--;
+    if (s->references <= 0) {
+        free(s->names);
+        free(s);
+    }
+}
+
+void zlscope_add(zlscope* s, zlatom* name) {
+    s->names = realloc(s->names, sizeof(zlatom*) * (s->count + 1));
+    s->names[s->count++] = name;
+}
+
+int zlscope_index(const zlscope* s, const zlatom* name) {
+    for (int i = 0; i < s->count; i++) {
+        if (s->names[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 zlenv* zlenv_new(void) {
-    zlenv* e = safe_malloc(sizeof(zlenv));
+    zlenv* e = zlpool_alloc(sizeof(zlenv));
     e->parent = NULL;
-    e->internal_dict = dict_new(zlval_copy_proxy, zlval_del_proxy);
+    e->internal_dict = NULL;
+    e->scope = NULL;
+    e->slots = NULL;
     e->top_level = false;
     e->references = 1;
+    zlgc_track(e);
     return e;
 }
 
+static zlval** zlenv_alloc_slots(zlenv* e, int count) {
+    if (count <= ZLENV_INLINE_SLOTS) {
+        return e->inline_slots;
+    }
+    return safe_malloc(sizeof(zlval*) * count);
+}
+
+zlenv* zlenv_new_frame(zlscope* s) {
+    zlenv* e = zlenv_new();
+    e->scope = zlscope_retain(s);
+    if (s->count) {
+        e->slots = zlenv_alloc_slots(e, s->count);
+        for (int i = 0; i < s->count; i++) {
+            e->slots[i] = NULL;
+        }
+    }
+    return e;
+}
+
+static int zlenv_slot(const zlenv* e, const zlatom* k) {
+    return e->scope ? zlscope_index(e->scope, k) : -1;
+}
+
 zlenv* zlenv_new_top_level(void) {
     zlenv* e = zlenv_new();
     e->top_level = true;
@@ -794,8 +1421,48 @@ void zlenv_del(zlenv* e) {
             zlenv_del(e->parent);
         }
 
-        dict_del(e->internal_dict);
-        free(e);
+        if (e->scope) {
+            for (int i = 0; i < e->scope->count; i++) {
+                if (e->slots[i]) {
+                    zlval_del(e->slots[i]);
+                }
+            }
+            if (e->slots != e->inline_slots) {
+                free(e->slots);
+            }
+            zlscope_release(e->scope);
+        }
+        if (e->internal_dict) {
+            dict_del(e->internal_dict);
+        }
+        zlgc_untrack(e);
+        zlpool_free(e, sizeof(zlenv));
+    }
+}
+
+void zlenv_clear(zlenv* e) {
+    /* drops every binding and the parent; each is detached from e before
+     * being deleted, as deleting it may lead back to e */
+    if (e->parent) {
+        zlenv* parent = e->parent;
+        e->parent = NULL;
+        zlenv_del(parent);
+    }
+
+    if (e->scope) {
+        for (int i = 0; i < e->scope->count; i++) {
+            zlval* x = e->slots[i];
+            e->slots[i] = NULL;
+            if (x) {
+                zlval_del(x);
+            }
+        }
+    }
+
+    dict* d = e->internal_dict;
+    e->internal_dict = NULL;
+    if (d) {
+        dict_del(d);
     }
 }
 
@@ -806,11 +1473,20 @@ void zlenv_del_top_level(zlenv* e) {
 }
 
 int zlenv_index(zlenv* e, zlval* k) {
-    return dict_index(e->internal_dict, k->sym);
+    int i = zlenv_slot(e, k->atom);
+    if (i != -1 && e->slots[i]) {
+        return i;
+    }
+    return e->internal_dict ? dict_index(e->internal_dict, k->atom) : -1;
 }
 
-static zlval* zlenv_lookup(zlenv* e, char* k) {
-    int i = dict_index(e->internal_dict, k);
+static zlval* zlenv_lookup(zlenv* e, zlatom* k) {
+    int i = zlenv_slot(e, k);
+    if (i != -1 && e->slots[i]) {
+        return zlval_copy(e->slots[i]);
+    }
+
+    i = e->internal_dict ? dict_index(e->internal_dict, k) : -1;
     if (i != -1) {
         return dict_get_at(e->internal_dict, i);
     }
@@ -819,16 +1495,45 @@ static zlval* zlenv_lookup(zlenv* e, char* k) {
     if (e->parent) {
         return zlenv_lookup(e->parent, k);
     } else {
-        return zlval_err("unbound symbol '%s'", k);
+        return zlval_err("unbound symbol '%s'", k->name);
     }
 }
 
 zlval* zlenv_get(zlenv* e, zlval* k) {
-    return zlenv_lookup(e, k->sym);
+    return zlenv_lookup(e, k->atom);
+}
+
+zlval* zlenv_get_slot(zlenv* e, zlval* k, int depth, int slot) {
+    /* Looks up a local resolved to a slot depth frames up. Names defined
+     * at runtime in any frame in between may shadow it, in which case the
+     * lookup goes by name instead */
+    zlenv* f = e;
+    for (int i = 0; i < depth; i++) {
+        if (f->internal_dict && dict_count(f->internal_dict)) {
+            return zlenv_lookup(e, k->atom);
+        }
+        f = f->parent;
+    }
+    if (f->slots[slot]) {
+        return zlval_copy(f->slots[slot]);
+    }
+    return zlenv_lookup(e, k->atom);
 }
 
 void zlenv_put(zlenv* e, zlval* k, zlval* v) {
-    dict_put(e->internal_dict, k->sym, v);
+    int i = zlenv_slot(e, k->atom);
+    if (i != -1) {
+        zlval* x = zlval_copy(v);
+        if (e->slots[i]) {
+            zlval_del(e->slots[i]);
+        }
+        e->slots[i] = x;
+        return;
+    }
+    if (!e->internal_dict) {
+        e->internal_dict = dict_new(zlval_copy_proxy, zlval_del_proxy);
+    }
+    dict_put(e->internal_dict, k->atom, v);
 }
 
 void zlenv_put_global(zlenv* e, zlval* k, zlval* v) {
@@ -839,19 +1544,31 @@ void zlenv_put_global(zlenv* e, zlval* k, zlval* v) {
 }
 
 zlenv* zlenv_copy(zlenv* e) {
-    zlenv* n = safe_malloc(sizeof(zlenv));
+    zlenv* n = zlpool_alloc(sizeof(zlenv));
     n->parent = e->parent;
     if (n->parent) {
         n->parent->references++;
     }
-    n->internal_dict = dict_copy(e->internal_dict);
+    n->internal_dict = e->internal_dict ? dict_copy(e->internal_dict) : NULL;
+    n->scope = NULL;
+    n->slots = NULL;
+    if (e->scope) {
+        n->scope = zlscope_retain(e->scope);
+    }
+    if (e->slots) {
+        n->slots = zlenv_alloc_slots(n, e->scope->count);
+        for (int i = 0; i < e->scope->count; i++) {
+            n->slots[i] = e->slots[i] ? zlval_copy(e->slots[i]) : NULL;
+        }
+    }
     n->top_level = e->top_level;
     n->references = 1;
+    zlgc_track(n);
 
     return n;
 }
 
-void zlenv_add_builtin(zlenv* e, char* name, zlbuiltin builtin) {
+void zlenv_add_builtin(zlenv* e, const char* name, zlbuiltin builtin) {
     zlval* k = zlval_sym(name);
     zlval* v = zlval_fun(builtin, name);
     zlenv_put(e, k, v);
@@ -859,62 +1576,103 @@ void zlenv_add_builtin(zlenv* e, char* name, zlbuiltin builtin) {
     zlval_del(v);
 }
 
+/* every builtin, by the name it is bound to at the top level, with the
+ * arg counts it accepts (max -1 for no limit); each checks its count
+ * before evaluating any args */
+static const struct {
+    const char* name;
+    zlbuiltin builtin;
+    int min_args;
+    int max_args;
+} builtins[] = {
+    { "+", builtin_add, 2, -1 },
+    { "-", builtin_sub, 1, -1 },
+    { "*", builtin_mul, 2, -1 },
+    { "/", builtin_div, 2, -1 },
+    { "//", builtin_trunc_div, 2, -1 },
+    { "%", builtin_mod, 2, -1 },
+    { "^", builtin_pow, 2, -1 },
+
+    { ">", builtin_gt, 2, 2 },
+    { ">=", builtin_gte, 2, 2 },
+    { "<", builtin_lt, 2, 2 },
+    { "<=", builtin_lte, 2, 2 },
+
+    { "==", builtin_eq, 2, 2 },
+    { "!=", builtin_neq, 2, 2 },
+
+    { "and", builtin_and, 0, -1 },
+    { "or", builtin_or, 0, -1 },
+    { "not", builtin_not, 1, 1 },
+
+    { "head", builtin_head, 1, 1 },
+    { "qhead", builtin_qhead, 1, 1 },
+    { "tail", builtin_tail, 1, 1 },
+    { "first", builtin_first, 1, 1 },
+    { "last", builtin_last, 1, 1 },
+    { "list", builtin_list, 0, -1 },
+    { "eval", builtin_eval, 1, 1 },
+    { "append", builtin_append, 2, -1 },
+    { "cons", builtin_cons, 2, 2 },
+    { "except-last", builtin_exceptlast, 1, 1 },
+    { "dict-get", builtin_dictget, 2, 2 },
+    { "dict-set", builtin_dictset, 3, 3 },
+    { "dict-del", builtin_dictdel, 2, 2 },
+    { "dict-haskey?", builtin_dicthaskey, 2, 2 },
+    { "dict-keys", builtin_dictkeys, 1, 1 },
+    { "dict-vals", builtin_dictvals, 1, 1 },
+
+    { "len", builtin_len, 1, 1 },
+    { "reverse", builtin_reverse, 1, 1 },
+    { "slice", builtin_slice, 2, 4 },
+
+    { "if", builtin_if, 0, -1 },
+    { "define", builtin_define, 0, -1 },
+    { "global", builtin_global, 0, -1 },
+
+    { "let", builtin_let, 0, -1 },
+    { "fn", builtin_lambda, 0, -1 },
+    { "macro", builtin_macro, 0, -1 },
+
+    { "typeof", builtin_typeof, 1, 1 },
+    { "convert", builtin_convert, 2, 2 },
+    { "import", builtin_import, 1, 1 },
+    { "print", builtin_print, 0, -1 },
+    { "println", builtin_println, 0, -1 },
+    { "random", builtin_random, 0, 0 },
+    { "alloc-stats", builtin_allocstats, 0, 0 },
+    { "gc", builtin_gc, 0, 0 },
+    { "gc-threshold", builtin_gcthreshold, 1, 1 },
+    { "macro-expansions", builtin_macroexpansions, 1, 1 },
+    { "error", builtin_error, 1, 1 },
+    { "exit", builtin_exit, 0, -1 },
+};
+
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+
 void zlenv_add_builtins(zlenv* e) {
-    zlenv_add_builtin(e, "+", builtin_add);
-    zlenv_add_builtin(e, "-", builtin_sub);
-    zlenv_add_builtin(e, "*", builtin_mul);
-    zlenv_add_builtin(e, "/", builtin_div);
-    zlenv_add_builtin(e, "//", builtin_trunc_div);
-    zlenv_add_builtin(e, "%", builtin_mod);
-    zlenv_add_builtin(e, "^", builtin_pow);
-
-    zlenv_add_builtin(e, ">", builtin_gt);
-    zlenv_add_builtin(e, ">=", builtin_gte);
-    zlenv_add_builtin(e, "<", builtin_lt);
-    zlenv_add_builtin(e, "<=", builtin_lte);
-
-    zlenv_add_builtin(e, "==", builtin_eq);
-    zlenv_add_builtin(e, "!=", builtin_neq);
-
-    zlenv_add_builtin(e, "and", builtin_and);
-    zlenv_add_builtin(e, "or", builtin_or);
-    zlenv_add_builtin(e, "not", builtin_not);
-
-    zlenv_add_builtin(e, "head", builtin_head);
-    zlenv_add_builtin(e, "qhead", builtin_qhead);
-    zlenv_add_builtin(e, "tail", builtin_tail);
-    zlenv_add_builtin(e, "first", builtin_first);
-    zlenv_add_builtin(e, "last", builtin_last);
-    zlenv_add_builtin(e, "list", builtin_list);
-    zlenv_add_builtin(e, "eval", builtin_eval);
-    zlenv_add_builtin(e, "append", builtin_append);
-    zlenv_add_builtin(e, "cons", builtin_cons);
-    zlenv_add_builtin(e, "except-last", builtin_exceptlast);
-    zlenv_add_builtin(e, "dict-get", builtin_dictget);
-    zlenv_add_builtin(e, "dict-set", builtin_dictset);
-    zlenv_add_builtin(e, "dict-del", builtin_dictdel);
-    zlenv_add_builtin(e, "dict-haskey?", builtin_dicthaskey);
-    zlenv_add_builtin(e, "dict-keys", builtin_dictkeys);
-    zlenv_add_builtin(e, "dict-vals", builtin_dictvals);
-
-    zlenv_add_builtin(e, "len", builtin_len);
-    zlenv_add_builtin(e, "reverse", builtin_reverse);
-    zlenv_add_builtin(e, "slice", builtin_slice);
-
-    zlenv_add_builtin(e, "if", builtin_if);
-    zlenv_add_builtin(e, "define", builtin_define);
-    zlenv_add_builtin(e, "global", builtin_global);
-
-    zlenv_add_builtin(e, "let", builtin_let);
-    zlenv_add_builtin(e, "fn", builtin_lambda);
-    zlenv_add_builtin(e, "macro", builtin_macro);
-
-    zlenv_add_builtin(e, "typeof", builtin_typeof);
-    zlenv_add_builtin(e, "convert", builtin_convert);
-    zlenv_add_builtin(e, "import", builtin_import);
-    zlenv_add_builtin(e, "print", builtin_print);
-    zlenv_add_builtin(e, "println", builtin_println);
-    zlenv_add_builtin(e, "random", builtin_random);
-    zlenv_add_builtin(e, "error", builtin_error);
-    zlenv_add_builtin(e, "exit", builtin_exit);
-}
\ No newline at end of file
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        zlenv_add_builtin(e, builtins[i].name, builtins[i].builtin);
+    }
+}
+
+zlbuiltin zlbuiltin_lookup(const char* name) {
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (streq(builtins[i].name, name)) {
+            return builtins[i].builtin;
+        }
+    }
+    return NULL;
+}
+
+void zlbuiltin_arity(zlbuiltin builtin, int* min_args, int* max_args) {
+    *min_args = 0;
+    *max_args = -1;
+    for (size_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (builtins[i].builtin == builtin) {
+            *min_args = builtins[i].min_args;
+            *max_args = builtins[i].max_args;
+            return;
+        }
+    }
+}
@@ -124,7 +124,7 @@ char* get_base_path(void) {
 #else
     // Executable is in 'bin' directory, so we need to go up twice
     char* exe_path = get_executable_path();
-    char* base_path = path_join(dirname(exe_path), "../");
+    char* base_path = path_join(dirname(exe_path), "../..");
     free(exe_path);
     return base_path;
 #endif
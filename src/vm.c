@@ -0,0 +1,324 @@
+#include "../include/vm.h"
+
+#include <stdlib.h>
+
+#include "../include/builtins.h"
+#include "../include/compile.h"
+#include "../include/eval.h"
+#include "../include/gc.h"
+#include "../include/util.h"
+
+#define VM_STACK_INITIAL_SIZE 256
+#define VM_STACK_GROWTH_FACTOR 2
+
+static zlval** stack = NULL;
+static int stack_count = 0;
+static int stack_size = 0;
+
+static void stack_reserve(int n) {
+    if (stack_count + n <= stack_size) {
+        return;
+    }
+    while (stack_count + n > stack_size) {
+        stack_size = stack_size ? stack_size * VM_STACK_GROWTH_FACTOR : VM_STACK_INITIAL_SIZE;
+    }
+    stack = realloc(stack, sizeof(zlval*) * stack_size);
+}
+
+static void stack_unwind(int base) {
+    while (stack_count > base) {
+        zlval_del(stack[--stack_count]);
+    }
+}
+
+/* functions rather than macros: pushed values are often computed by nested
+ * calls into the VM, which may move the stack */
+static inline void push(zlval* v) {
+    stack[stack_count++] = v;
+}
+
+static inline zlval* pop(void) {
+    return stack[--stack_count];
+}
+
+static inline zlval* peek(void) {
+    return stack[stack_count - 1];
+}
+
+void zlvm_teardown(void) {
+    stack_unwind(0);
+    free(stack);
+    stack = NULL;
+    stack_size = 0;
+}
+
+zlchunk* zlvm_load(zlval* f) {
+    zlchunk* c = f->proto->chunk;
+    if (c->state == ZLCHUNK_PENDING) {
+        zlchunk_compile(c, f->proto->body, f->env);
+    }
+    return c->state == ZLCHUNK_COMPILED ? c : NULL;
+}
+
+static bool is_special_form(zlbuiltin b) {
+    /* builtins that decide for themselves which args get evaluated */
+    return b == builtin_if || b == builtin_define || b == builtin_global ||
+        b == builtin_let || b == builtin_lambda || b == builtin_macro ||
+        b == builtin_and || b == builtin_or || b == builtin_exit;
+}
+
+static bool takes_args(const zlval* f, int argc) {
+    /* whether a function has formals left for argc args; zlval_call
+     * stops at the first one that doesn't fit, before evaluating it */
+    const zlproto* p = f->proto;
+    int left = p->formals->count - f->bound;
+    return p->variadic ? left > 0 || argc == 0 : argc <= left;
+}
+
+static bool fits_builtin(const zlval* f, int argc) {
+    /* a builtin given the wrong count reports it before evaluating any
+     * args, so that call goes through the tree walker unevaluated */
+    return !is_special_form(f->builtin) && argc >= f->min_args &&
+        (f->max_args < 0 || argc <= f->max_args);
+}
+
+static zlval* collect_args(int argc) {
+    zlval* a = zlval_sexpr();
+    for (int i = stack_count - argc; i < stack_count; i++) {
+        zlval_add(a, stack[i]);
+    }
+    stack_count -= argc;
+    a->evaluated = true;
+    return a;
+}
+
+static bool rebind_frame(zlenv* e, const zlchunk* c, int argc) {
+    /* A call to the running function in tail position binds its args
+     * straight into the frame it is called from, as long as nothing else
+     * holds that frame and nothing was defined in it at runtime */
+    zlval* f = stack[stack_count - argc - 1];
+    if (f->type != ZLVAL_FN || f->proto->chunk != c || f->bound != 0 ||
+            f->proto->variadic || f->proto->arity != argc) {
+        return false;
+    }
+    if (e->references != 1 || e->internal_dict || e->parent != f->env->parent) {
+        return false;
+    }
+
+    zlval* formals = f->proto->formals;
+    for (int i = 0; i < argc; i++) {
+        zlval* x = stack[stack_count - argc + i];
+        zlenv_put(e, formals->cell[i], x);
+        zlval_del(x);
+    }
+    stack_count -= argc;
+    zlval_del(pop());
+    return true;
+}
+
+static zlval* form_args(const zlval* form) {
+    zlval* a = zlval_sexpr();
+    for (int i = 1; i < form->count; i++) {
+        zlval_add(a, zlval_copy(form->cell[i]));
+    }
+    return a;
+}
+
+static zlval* call_form(zlenv* e, zlval* f, zlval* form) {
+    if (f->type == ZLVAL_ERR) {
+        return f;
+    }
+    if (!ISCALLABLE(f->type)) {
+        zlval* err = zlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
+                zlval_type_name(ZLVAL_SEXPR), zlval_type_name(f->type));
+        zlval_del(f);
+        return err;
+    }
+    zlval* x = zlval_kept_expansion(form, f);
+    if (!x) {
+        x = zlval_call_site(e, f, form_args(form), form);
+    }
+    zlval_del(f);
+    return x;
+}
+
+zlval* zlvm_exec(zlenv** e, zlchunk* c, bool* pending) {
+    /* Runs a compiled function body in frame e. A result flagged as pending
+     * is a call result that the caller still has to evaluate in *e, exactly
+     * as zlval_eval would have done with the result of an S-Expression */
+    int base = stack_count;
+    int ip = 0;
+    zlval* x;
+
+    *pending = false;
+    zlchunk_retain(c);
+    stack_reserve(c->max_stack);
+
+    while (true) {
+        zlopcode_t op = c->code[ip];
+        int arg = op == ZLOP_RETURN ? 0 : zlchunk_read_short(c, ip + 1);
+        ip += 3;
+
+        switch (op) {
+            case ZLOP_CONST:
+                push(zlval_copy(c->consts[arg]));
+                break;
+
+            case ZLOP_LOAD:
+                push(zlenv_get(*e, c->consts[arg]));
+                break;
+
+            case ZLOP_LOAD_SLOT:
+            {
+                int depth = zlchunk_read_short(c, ip);
+                int slot = zlchunk_read_short(c, ip + 2);
+                ip += 4;
+                push(zlenv_get_slot(*e, c->consts[arg], depth, slot));
+                break;
+            }
+
+            case ZLOP_EVAL:
+                push(zlval_eval(*e, zlval_copy(c->consts[arg])));
+                break;
+
+            case ZLOP_PREPARE:
+            {
+                int argc = zlchunk_read_short(c, ip);
+                ip += 2;
+                zlval* f = peek();
+                if (!((f->type == ZLVAL_FN && takes_args(f, argc)) ||
+                        (f->type == ZLVAL_BUILTIN && fits_builtin(f, argc)))) {
+                    ip = arg;
+                }
+                break;
+            }
+
+            case ZLOP_ARG:
+            {
+                int n = zlchunk_read_short(c, ip);
+                ip += 2;
+                x = peek();
+                if (x->type == ZLVAL_ERR && stack[stack_count - n - 1]->type == ZLVAL_FN) {
+                    /* the args after it are not evaluated */
+                    stack_count--;
+                    stack_unwind(stack_count - n);
+                    push(x);
+                    ip = arg;
+                }
+                break;
+            }
+
+            case ZLOP_INVOKE:
+            case ZLOP_TAIL_INVOKE:
+            {
+                if (zlval_eval_check_abort()) {
+                    x = zlval_err("eval aborted");
+                    goto done;
+                }
+                zlgc_poll();
+                if (op == ZLOP_TAIL_INVOKE && rebind_frame(*e, c, arg)) {
+                    stack_unwind(base);
+                    ip = 0;
+                    break;
+                }
+                zlval* a = collect_args(arg);
+                zlval* f = pop();
+                x = zlval_call(*e, f, a);
+                zlval_del(f);
+
+                if (op == ZLOP_TAIL_INVOKE) {
+                    goto tail;
+                }
+                push(zlval_eval_result(*e, x));
+                break;
+            }
+
+            case ZLOP_CALL:
+            case ZLOP_TAIL_CALL:
+            {
+                if (zlval_eval_check_abort()) {
+                    x = zlval_err("eval aborted");
+                    goto done;
+                }
+                zlgc_poll();
+                x = call_form(*e, pop(), c->consts[arg]);
+
+                if (op == ZLOP_TAIL_CALL) {
+                    goto tail;
+                }
+                push(zlval_eval_result(*e, x));
+                break;
+            }
+
+            case ZLOP_IF:
+            {
+                zlval* f = peek();
+                if (f->type == ZLVAL_BUILTIN && f->builtin == builtin_if) {
+                    zlval_del(pop());
+                } else {
+                    ip = arg;
+                }
+                break;
+            }
+
+            case ZLOP_BRANCH:
+            {
+                int end = zlchunk_read_short(c, ip);
+                ip += 2;
+
+                zlval* p = pop();
+                if (p->type == ZLVAL_ERR) {
+                    push(p);
+                    ip = end;
+                } else if (p->type != ZLVAL_BOOL) {
+                    push(zlval_err("function '%s' passed incorrect type for arg %i; got %s, expected %s",
+                            "if", 0, zlval_type_name(p->type), zlval_type_name(ZLVAL_BOOL)));
+                    zlval_del(p);
+                    ip = end;
+                } else {
+                    if (!p->bln) {
+                        ip = arg;
+                    }
+                    zlval_del(p);
+                }
+                break;
+            }
+
+            case ZLOP_JUMP:
+                ip = arg;
+                break;
+
+            case ZLOP_RETURN:
+                x = pop();
+                goto done;
+        }
+        continue;
+
+tail:
+        /* A call in tail position: enter compiled functions in place,
+         * hand everything else back to the caller */
+        if (x->type == ZLVAL_FN && x->called) {
+            zlchunk* next = zlvm_load(x);
+            if (next) {
+                stack_unwind(base);
+                zlenv_del(*e);
+                *e = zlval_enter(x);
+
+                zlchunk_retain(next);
+                zlchunk_release(c);
+                c = next;
+                zlval_del(x);
+                stack_reserve(c->max_stack);
+                ip = 0;
+                continue;
+            }
+        }
+        *pending = true;
+        goto done;
+    }
+
+done:
+    stack_unwind(base);
+    zlchunk_release(c);
+    return x;
+}
@@ -0,0 +1,100 @@
+#!/bin/bash
+# Images: a module imported once from source and once from the image
+# cached beside it must print the same. An image that is stale, damaged,
+# cut short or from another format must be passed over for the source
+# and written again, and scripts run directly must not leave one. Run
+# from the repository root, or through make check.
+set -e
+
+bin=${BIN:-out/bin/spow}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/lib.spow" <<'SPOW'
+(define greeting "tab\there, \"quoted\"\n")
+(define big (^ 3 100))
+(define marker 41)
+(define table [:a 1 2.5 {x y} {1 {2}} 'nested'])
+(define scale (fn (n x) (* n x)))
+(define triple (scale 3))
+(define unfinished {+ 1 \(+ 1 1) @{3 4}})
+(macro wrap (& xs) {list :'wrapped' @xs})
+SPOW
+
+cat > "$dir/main.spow" <<SPOW
+(import '$dir/lib.spow')
+(print greeting)
+(println big (- 0 big) 1.25 -7 marker)
+(println table (dict-keys table))
+(println (triple 14) (scale 2 0.5))
+(println unfinished (eval unfinished))
+(println (wrap 1 2))
+SPOW
+
+inode() {
+    stat -c %i "$dir/lib.spowc"
+}
+
+run() {
+    # each run must print what the source did and leave a valid image
+    "$bin" "$dir/main.spow" > "$dir/out.txt" 2>&1
+    if ! cmp -s "$dir/source.txt" "$dir/out.txt"; then
+        echo "images: FAILED, $1 printed something else"
+        diff "$dir/source.txt" "$dir/out.txt" | head -5
+        exit 1
+    fi
+}
+
+"$bin" "$dir/main.spow" > "$dir/source.txt" 2>&1
+if [ ! -s "$dir/lib.spowc" ] || grep -q "rror" "$dir/source.txt"; then
+    echo "images: FAILED, importing from source did not run cleanly and leave an image"
+    cat "$dir/source.txt"
+    exit 1
+fi
+if [ -e "$dir/main.spowc" ]; then
+    echo "images: FAILED, a script run directly was cached"
+    exit 1
+fi
+
+before=$(inode)
+run "the module read from its image"
+if [ "$(inode)" != "$before" ]; then
+    echo "images: FAILED, a valid image was written again instead of read"
+    exit 1
+fi
+
+# a module changed without changing its size
+sed -i 's/(define marker 41)/(define marker 42)/' "$dir/lib.spow"
+"$bin" "$dir/main.spow" > "$dir/out.txt" 2>&1
+if ! grep -q " 42$" "$dir/out.txt"; then
+    echo "images: FAILED, a stale image was read instead of the changed module"
+    cat "$dir/out.txt"
+    exit 1
+fi
+"$bin" "$dir/main.spow" > "$dir/source.txt" 2>&1
+cp "$dir/lib.spowc" "$dir/good.spowc"
+
+damage() {
+    # $1 describes it, and the rest of the args change lib.spowc
+    "${@:2}"
+    run "the module with $1"
+    if ! cmp -s "$dir/lib.spowc" "$dir/good.spowc"; then
+        echo "images: FAILED, $1 was not written again"
+        exit 1
+    fi
+    run "the image written again after $1"
+}
+
+flip() {
+    size=$(stat -c %s "$dir/lib.spowc")
+    printf '\xff\x00\xff' | dd of="$dir/lib.spowc" bs=1 seek=$((size / 2)) conv=notrunc status=none
+}
+
+damage "an image with damaged bytes" flip
+damage "an image with a string changed" sed -i 's/nested/NESTED/' "$dir/lib.spowc"
+damage "an image cut short" truncate -s -20 "$dir/lib.spowc"
+damage "an empty image" truncate -s 0 "$dir/lib.spowc"
+damage "an image of another format" sed -i '1s/^SPOWIMG1/SPOWIMG0/' "$dir/lib.spowc"
+damage "garbage for an image" sh -c "head -c 300 /dev/urandom > '$dir/lib.spowc'"
+
+echo "images: ok"
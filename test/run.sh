@@ -0,0 +1,25 @@
+#!/bin/bash
+# Runs every test/*.spow with the bytecode VM and with the tree walking
+# evaluator; each must print what test/*.expected has, errors included.
+# Run from the repository root, or through make check.
+set -e
+
+bin=${BIN:-out/bin/spow}
+walker=${WALKER:-out/check/walker/spow}
+status=0
+
+for t in test/*.spow; do
+    expected=${t%.spow}.expected
+    for b in "$bin" "$walker"; do
+        if ! "$b" "$t" 2>&1 | cmp -s "$expected" -; then
+            echo "$(basename "$t"): FAILED with $b"
+            "$b" "$t" 2>&1 | diff "$expected" - | head -5
+            status=1
+        fi
+    done
+done
+
+if [ $status -eq 0 ]; then
+    echo "scripts: ok"
+fi
+exit $status
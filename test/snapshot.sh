@@ -0,0 +1,101 @@
+#!/bin/bash
+# Snapshots: saving the environment after one script and running the
+# next from the snapshot must print what running both from source does,
+# with the files imported before the snapshot not imported again unless
+# they changed since. A snapshot that is damaged, cut short or in
+# another format must be refused with an error rather than half loaded.
+# Run from the repository root, or through make check.
+set -e
+
+bin=${BIN:-out/bin/spow}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/lib.spow" <<'SPOW'
+(println 'importing lib')
+(define scale (fn (n x) (* n x)))
+SPOW
+
+cat > "$dir/setup.spow" <<SPOW
+(import '$dir/lib.spow')
+(define big (^ 7 90))
+(define table [:a 1 2.5 {x y} {1 {2}} "nested \"str\""])
+(define triple (scale 3))
+(define counter (fn (n) (fn (x) (+ n x))))
+(define from-ten (counter 10))
+(define unfinished {+ 1 \(+ 1 1) @{3 4}})
+(macro wrap (& xs) {list :'wrapped' @xs})
+SPOW
+
+cat > "$dir/use.spow" <<SPOW
+(import '$dir/lib.spow')
+(println big table (dict-keys table))
+(println (triple 14) (from-ten 5) ((counter 1) 1))
+(println unfinished (eval unfinished) (wrap 1 2))
+(println (scale 2 0.5) (typeof scale) (typeof +) (+ 1 2))
+SPOW
+
+"$bin" "$dir/setup.spow" "$dir/use.spow" > "$dir/source.txt" 2>&1
+"$bin" --snapshot "$dir/env.snp" "$dir/setup.spow" > "$dir/out.txt" 2>&1
+"$bin" --from-snapshot "$dir/env.snp" "$dir/use.spow" >> "$dir/out.txt" 2>&1
+if grep -q "rror" "$dir/source.txt" || [ "$(grep -c importing "$dir/source.txt")" -ne 1 ] ||
+        ! cmp -s "$dir/source.txt" "$dir/out.txt"; then
+    echo "snapshot: FAILED, running from the snapshot printed something else"
+    diff "$dir/source.txt" "$dir/out.txt" | head -5
+    exit 1
+fi
+
+# a snapshot taken again from one restored holds the same
+"$bin" --from-snapshot "$dir/env.snp" --snapshot "$dir/again.snp" "$dir/use.spow" > /dev/null 2>&1
+"$bin" --from-snapshot "$dir/again.snp" "$dir/use.spow" > "$dir/out.txt" 2>&1
+if ! tail -n +2 "$dir/source.txt" | cmp -s - "$dir/out.txt"; then
+    echo "snapshot: FAILED, a snapshot of a restored environment lost something"
+    tail -n +2 "$dir/source.txt" | diff - "$dir/out.txt" | head -5
+    exit 1
+fi
+
+# a file run directly before the snapshot counts as imported too
+"$bin" --snapshot "$dir/lib.snp" "$dir/lib.spow" > /dev/null 2>&1
+"$bin" --from-snapshot "$dir/lib.snp" "$dir/setup.spow" "$dir/use.spow" > "$dir/out.txt" 2>&1
+if ! tail -n +2 "$dir/source.txt" | cmp -s - "$dir/out.txt"; then
+    echo "snapshot: FAILED, a file run before the snapshot was imported again"
+    tail -n +2 "$dir/source.txt" | diff - "$dir/out.txt" | head -5
+    exit 1
+fi
+
+# an imported file changed since the snapshot is imported again
+touch -d "+1 minute" "$dir/lib.spow"
+"$bin" --from-snapshot "$dir/env.snp" "$dir/use.spow" > "$dir/out.txt" 2>&1
+if [ "$(head -1 "$dir/out.txt")" != "importing lib" ]; then
+    echo "snapshot: FAILED, a file changed since the snapshot was not imported again"
+    head -3 "$dir/out.txt"
+    exit 1
+fi
+
+refused() {
+    # $1 describes it, and the rest of the args change bad.snp
+    cp "$dir/env.snp" "$dir/bad.snp"
+    "${@:2}"
+    status=0
+    "$bin" --from-snapshot "$dir/bad.snp" "$dir/use.spow" > "$dir/out.txt" 2>&1 || status=$?
+    if [ $status -ne 1 ] || ! grep -q "could not restore a snapshot" "$dir/out.txt"; then
+        echo "snapshot: FAILED, $1 was not refused cleanly (exit status $status)"
+        head -3 "$dir/out.txt"
+        exit 1
+    fi
+}
+
+flip() {
+    size=$(stat -c %s "$dir/bad.snp")
+    printf '\xff\x00\xff' | dd of="$dir/bad.snp" bs=1 seek=$((size / 2)) conv=notrunc status=none
+}
+
+refused "a snapshot with damaged bytes" flip
+refused "a snapshot with a string changed" sed -i 's/nested/NESTED/' "$dir/bad.snp"
+refused "a snapshot cut short" truncate -s -20 "$dir/bad.snp"
+refused "an empty snapshot" truncate -s 0 "$dir/bad.snp"
+refused "a snapshot of the previous format" sed -i '1s/^SPOWSNP2/SPOWSNP1/' "$dir/bad.snp"
+refused "a cached image given as a snapshot" cp "$dir/lib.spowc" "$dir/bad.snp"
+refused "a missing snapshot" rm "$dir/bad.snp"
+
+echo "snapshot: ok"
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Streaming reader: a generated script several times the size of the
+# reader's buffer is run once from a pipe, which is read through the
+# buffer a bit at a time, and once as a file, which is mapped, and both
+# must print the same. Forms, strings and comments straddle the buffer's
+# refills, and one form and one string are longer than the buffer. Run
+# from the repository root, or through make check.
+set -e
+
+bin=${BIN:-out/bin/spow}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk 'BEGIN {
+    for (i = 0; i < 4000; i++) {
+        printf "(println %d \"a string \\\"%d\\\" with\\ta tab\" :q%d {%d.5 [:k %d]}  # comment\n    (+ %d 1))\n", i, i, i, i, i, i
+    }
+    printf "(println (len {"
+    for (i = 0; i < 20000; i++) {
+        printf " %d", i
+    }
+    printf "}))\n(println (len \""
+    for (i = 0; i < 100000; i++) {
+        printf "x"
+    }
+    printf "\"))\n"
+}' > "$dir/input.spow"
+
+"$bin" "$dir/input.spow" > "$dir/mapped.txt"
+cat "$dir/input.spow" | "$bin" - > "$dir/streamed.txt"
+
+if [ "$(wc -l < "$dir/mapped.txt")" -ne 4002 ] || ! cmp -s "$dir/mapped.txt" "$dir/streamed.txt"; then
+    echo "stream: FAILED, the script read from a pipe printed something else"
+    diff "$dir/mapped.txt" "$dir/streamed.txt" | head -5
+    exit 1
+fi
+
+printf '(println 1)\n(println "a' | "$bin" - > "$dir/error.txt"
+if ! grep -q '/dev/stdin:2:10: error: unterminated string' "$dir/error.txt"; then
+    echo "stream: FAILED, a syntax error in a pipe was not reported where it is"
+    cat "$dir/error.txt"
+    exit 1
+fi
+
+echo "stream: ok"